@@ -1,8 +1,11 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -16,6 +19,9 @@ struct fat_boot {
 	unsigned int root_dir_cluster;
 };
 
+/* Clusters summarized by one free count. */
+#define FAT_CHUNK 512
+
 /* FAT FS */
 struct fat_fs {
 	struct fat_boot bs;
@@ -24,12 +30,20 @@ struct fat_fs {
 	disk_sector_t data_start;
 	cluster_t last_clst;
 	struct lock write_lock;
+
+	/* Free-cluster index, kept up to date by fat_put().  A bit per
+	 * cluster, set if it is free, and the number of free clusters in
+	 * each FAT_CHUNK of them, so that allocation skips full chunks
+	 * without looking at their bits. */
+	struct bitmap *free_clusters;
+	unsigned int *chunk_free;
 };
 
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_index_init (void);
 
 void
 fat_init (void) {
@@ -38,12 +52,7 @@ fat_init (void) {
 		PANIC ("FAT init failed");
 
 	// Read boot sector from the disk
-	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
-	free (bounce);
+	buffer_cache_read (FAT_BOOT_SECTOR, &fat_fs->bs, 0, sizeof (fat_fs->bs));
 
 	// Extract FAT info
 	if (fat_fs->bs.magic != FAT_MAGIC)
@@ -57,59 +66,44 @@ fat_open (void) {
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
 
-	// Load FAT directly from the disk
+	// Load FAT through the buffer cache
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_read = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+		if (bytes_left > DISK_SECTOR_SIZE)
+			bytes_left = DISK_SECTOR_SIZE;
+		buffer_cache_read (fat_fs->bs.fat_start + i, buffer + bytes_read, 0,
+				bytes_left);
+		bytes_read += bytes_left;
 	}
+	fat_index_init ();
 }
 
 void
 fat_close (void) {
 	// Write FAT boot sector
-	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT close failed");
-	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	free (bounce);
-
-	// Write FAT directly to the disk
+	static uint8_t zeros[DISK_SECTOR_SIZE];
+	buffer_cache_write (FAT_BOOT_SECTOR, zeros, 0, DISK_SECTOR_SIZE);
+	buffer_cache_write (FAT_BOOT_SECTOR, &fat_fs->bs, 0, sizeof (fat_fs->bs));
+
+	// Write FAT through the buffer cache; filesys_done() flushes it
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_wrote = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
+		if (bytes_left >= DISK_SECTOR_SIZE)
+			bytes_left = DISK_SECTOR_SIZE;
+		else
+			buffer_cache_write (fat_fs->bs.fat_start + i, zeros, 0,
+					DISK_SECTOR_SIZE);
+		buffer_cache_write (fat_fs->bs.fat_start + i, buffer + bytes_wrote, 0,
+				bytes_left);
+		bytes_wrote += bytes_left;
 	}
 }
 
@@ -123,16 +117,15 @@ fat_create (void) {
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_index_init ();
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
-	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
-	if (buf == NULL)
-		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
-	free (buf);
+	static uint8_t zeros[DISK_SECTOR_SIZE];
+	buffer_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), zeros, 0,
+			DISK_SECTOR_SIZE);
 }
 
 void
@@ -152,7 +145,70 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	/* Clusters start right after the FAT, ROOT_DIR_CLUSTER first.
+	 * Cluster 0 means "none" and has no sector. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	if (fat_fs->fat_length
+			> fat_fs->bs.fat_sectors * DISK_SECTOR_SIZE / sizeof (cluster_t))
+		fat_fs->fat_length =
+			fat_fs->bs.fat_sectors * DISK_SECTOR_SIZE / sizeof (cluster_t);
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* Builds the free-cluster index from the FAT just loaded or created. */
+static void
+fat_index_init (void) {
+	size_t chunk_cnt = DIV_ROUND_UP (fat_fs->fat_length, FAT_CHUNK);
+	cluster_t clst;
+
+	bitmap_destroy (fat_fs->free_clusters);
+	free (fat_fs->chunk_free);
+	fat_fs->free_clusters = bitmap_create (fat_fs->fat_length);
+	fat_fs->chunk_free = calloc (chunk_cnt, sizeof *fat_fs->chunk_free);
+	if (fat_fs->free_clusters == NULL || fat_fs->chunk_free == NULL)
+		PANIC ("FAT index creation failed");
+
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] == 0) {
+			bitmap_mark (fat_fs->free_clusters, clst);
+			fat_fs->chunk_free[clst / FAT_CHUNK]++;
+		}
+}
+
+/* Returns a free cluster, trying HINT first and then going on from it
+ * to the end of the FAT and round to its start, or 0 if the disk is
+ * full.  Chunks without a free cluster are skipped whole. */
+static cluster_t
+fat_find_free (cluster_t hint) {
+	size_t chunk_cnt = DIV_ROUND_UP (fat_fs->fat_length, FAT_CHUNK);
+	size_t chunk, i;
+
+	if (hint == 0 || hint >= fat_fs->fat_length)
+		hint = 1;
+	if (bitmap_test (fat_fs->free_clusters, hint))
+		return hint;
+
+	chunk = hint / FAT_CHUNK;
+	for (i = 0; i <= chunk_cnt; i++, chunk = (chunk + 1) % chunk_cnt) {
+		size_t start = chunk * FAT_CHUNK;
+		size_t end = start + FAT_CHUNK;
+		size_t clst;
+
+		if (fat_fs->chunk_free[chunk] == 0)
+			continue;
+		/* The first time round, only what follows HINT. */
+		if (i == 0 && hint > start)
+			start = hint;
+		if (end > fat_fs->fat_length)
+			end = fat_fs->fat_length;
+		for (clst = start; clst < end; clst++)
+			if (bitmap_test (fat_fs->free_clusters, clst))
+				return clst;
+	}
+	return 0;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -161,33 +217,86 @@ fat_fs_init (void) {
 
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
- * Returns 0 if fails to allocate a new cluster. */
+ * Returns 0 if fails to allocate a new cluster.
+ * The new cluster is the one right after CLST if that is free, so that
+ * a file grows in place; otherwise the next free one after the last
+ * cluster allocated. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new;
+
+	lock_acquire (&fat_fs->write_lock);
+	new = 0;
+	if (clst != 0 && clst + 1 < fat_fs->fat_length
+			&& bitmap_test (fat_fs->free_clusters, clst + 1))
+		new = clst + 1;
+	else
+		new = fat_find_free (fat_fs->last_clst);
+	if (new != 0) {
+		fat_put (new, EOChain);
+		if (clst != 0)
+			fat_put (clst, new);
+		fat_fs->last_clst = new + 1;
+	}
+	lock_release (&fat_fs->write_lock);
+	return new;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+
+		fat_put (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	cluster_t old;
+
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+
+	old = fat_fs->fat[clst];
+	fat_fs->fat[clst] = val;
+	if ((old == 0) != (val == 0)) {
+		bitmap_set (fat_fs->free_clusters, clst, val == 0);
+		if (val == 0)
+			fat_fs->chunk_free[clst / FAT_CHUNK]++;
+		else
+			fat_fs->chunk_free[clst / FAT_CHUNK]--;
+	}
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Returns the number of free clusters. */
+size_t
+fat_free_cnt (void) {
+	size_t chunk_cnt = DIV_ROUND_UP (fat_fs->fat_length, FAT_CHUNK);
+	size_t cnt = 0, i;
+
+	for (i = 0; i < chunk_cnt; i++)
+		cnt += fat_fs->chunk_free[i];
+	return cnt;
 }
@@ -3,11 +3,18 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window, see file_readahead(). */
+#define READAHEAD_MIN (4 * DISK_SECTOR_SIZE)
+#define READAHEAD_MAX (32 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	off_t ra_next;              /* Where a sequential read goes on. */
+	off_t ra_end;               /* End of what was read ahead. */
+	off_t ra_window;            /* Bytes to read ahead. */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -64,6 +71,37 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that SIZE bytes were just read from FILE at OFS.  While FILE is
+ * read sequentially, has the buffer cache read the window of bytes
+ * that follow in the background.  The window doubles, up to
+ * READAHEAD_MAX, with every read that goes on where the last one
+ * ended, and halves with every read that does not. */
+static void
+file_readahead (struct file *file, off_t ofs, off_t size) {
+	off_t start, end;
+
+	if (ofs == file->ra_next) {
+		if (file->ra_window == 0)
+			file->ra_window = READAHEAD_MIN;
+		else if (file->ra_window * 2 < READAHEAD_MAX)
+			file->ra_window *= 2;
+		else
+			file->ra_window = READAHEAD_MAX;
+	} else {
+		file->ra_window /= 2;
+		file->ra_end = 0;
+	}
+	file->ra_next = ofs + size;
+
+	/* Only ask for what was not asked for already. */
+	start = file->ra_next > file->ra_end ? file->ra_next : file->ra_end;
+	end = file->ra_next + file->ra_window;
+	if (start < end) {
+		inode_readahead (file->inode, start, end - start);
+		file->ra_end = end;
+	}
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -72,6 +110,8 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	if (bytes_read > 0)
+		file_readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +123,10 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+	if (bytes_read > 0)
+		file_readahead (file, file_ofs, bytes_read);
+	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
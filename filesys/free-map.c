@@ -36,6 +36,26 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates the free sectors that follow one another from SECTOR on,
+ * at most CNT of them.  Returns how many it allocated, which is 0 if
+ * SECTOR itself is in use. */
+size_t
+free_map_extend (disk_sector_t sector, size_t cnt) {
+	size_t n = 0;
+
+	while (n < cnt && sector + n < bitmap_size (free_map)
+			&& !bitmap_test (free_map, sector + n))
+		n++;
+	if (n > 0) {
+		bitmap_set_multiple (free_map, sector, n, true);
+		if (free_map_file != NULL && !bitmap_write (free_map, free_map_file)) {
+			bitmap_set_multiple (free_map, sector, n, false);
+			n = 0;
+		}
+	}
+	return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
@@ -4,9 +4,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "filesys/directory.h"
+#include "filesys/fat.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "devices/disk.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -187,3 +189,57 @@ fsutil_get (char **argv) {
 	file_close (src);
 	free (buffer);
 }
+
+#ifdef EFILESYS
+/* Grows one chain over every free cluster, then frees every other
+ * cluster of it and allocates them again as single-cluster chains,
+ * and prints how long each took and how many clusters were placed
+ * right after the tail of their chain.  Gives everything back at the
+ * end, and writes nothing but the FAT. */
+void
+fsutil_fat_bench (char **argv UNUSED) {
+	size_t free_cnt = fat_free_cnt ();
+	cluster_t *clusters, clst;
+	size_t cnt, adjacent, i;
+	int64_t start;
+
+	printf ("Allocating %zu free clusters...\n", free_cnt);
+	clusters = malloc (free_cnt * sizeof *clusters);
+	if (clusters == NULL)
+		PANIC ("couldn't allocate cluster list");
+
+	start = timer_ticks ();
+	clst = fat_create_chain (0);
+	cnt = adjacent = 0;
+	while (clst != 0) {
+		cluster_t next;
+
+		clusters[cnt++] = clst;
+		next = fat_create_chain (clst);
+		if (next == clst + 1)
+			adjacent++;
+		clst = next;
+	}
+	printf ("Grew a chain of %zu clusters in %"PRId64" ticks, "
+			"%zu next to the tail.\n", cnt, timer_elapsed (start), adjacent);
+
+	/* Leave every other cluster free, then fill the holes. */
+	for (i = 1; i < cnt; i += 2)
+		fat_put (clusters[i], 0);
+	start = timer_ticks ();
+	for (i = 1; i < cnt; i += 2)
+		clusters[i] = fat_create_chain (0);
+	printf ("Filled %zu holes in %"PRId64" ticks.\n", cnt / 2,
+			timer_elapsed (start));
+
+	for (i = 1; i < cnt; i += 2)
+		if (clusters[i] != 0)
+			fat_remove_chain (clusters[i], 0);
+	for (i = 0; i < cnt; i += 2)
+		fat_put (clusters[i], 0);
+	free (clusters);
+	if (fat_free_cnt () != free_cnt)
+		PANIC ("FAT lost clusters: %zu free, %zu before",
+				fat_free_cnt (), free_cnt);
+}
+#endif
@@ -2,21 +2,51 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/page_cache.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Extents held in the inode itself, and in its spill block. */
+#define INODE_EXTENTS 41
+#define SPILL_EXTENTS 42
+#define MAX_EXTENTS (INODE_EXTENTS + SPILL_EXTENTS)
+
+/* A run of consecutive sectors of a file.  A file's extents are kept in
+ * file order, so FIRST goes up from one to the next and a sector is
+ * found by binary search. */
+struct extent {
+	uint32_t first;                     /* First file sector held. */
+	disk_sector_t start;                /* First disk sector. */
+	uint32_t cnt;                       /* Number of sectors. */
+};
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The first INODE_EXTENTS extents are stored here, the rest in the
+ * spill block, which is allocated when they run out.  Allocation tries
+ * to go on right after the last extent, so a file that is written
+ * sequentially mostly stays in a few long extents. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents in use. */
+	disk_sector_t spill;                /* Spill block, or 0 if none. */
+	struct extent extents[INODE_EXTENTS];
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* The spill block of an inode with more than INODE_EXTENTS extents. */
+struct extent_block {
+	struct extent extents[SPILL_EXTENTS];
+	uint32_t unused[2];                 /* Not used. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,6 +56,10 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* Lookups answered by an inode's hint, and by searching its extents. */
+static long long hint_hits;
+static long long hint_misses;
+
 /* In-memory inode. */
 struct inode {
 	struct list_elem elem;              /* Element in inode list. */
@@ -34,19 +68,222 @@ struct inode {
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+	size_t hint_idx;                    /* Index of HINT in the extents. */
+	struct extent hint;                 /* Last extent found, or cnt 0. */
 };
 
+/* Returns extent IDX of DISK. */
+static struct extent
+extent_get (const struct inode_disk *disk, size_t idx) {
+	struct extent e;
+
+	ASSERT (idx < disk->extent_cnt);
+	if (idx < INODE_EXTENTS)
+		return disk->extents[idx];
+	buffer_cache_read (disk->spill, &e,
+			(idx - INODE_EXTENTS) * sizeof e, sizeof e);
+	return e;
+}
+
+/* Sets extent IDX of DISK to E.  The caller writes DISK back. */
+static void
+extent_put (struct inode_disk *disk, size_t idx, const struct extent *e) {
+	if (idx < INODE_EXTENTS)
+		disk->extents[idx] = *e;
+	else
+		buffer_cache_write (disk->spill, e,
+				(idx - INODE_EXTENTS) * sizeof *e, sizeof *e);
+}
+
+/* Returns the number of sectors DISK's extents hold. */
+static size_t
+extents_size (const struct inode_disk *disk) {
+	struct extent last;
+
+	if (disk->extent_cnt == 0)
+		return 0;
+	last = extent_get (disk, disk->extent_cnt - 1);
+	return last.first + last.cnt;
+}
+
+/* Returns whether extent E holds file sector IDX. */
+static inline bool
+extent_holds (const struct extent *e, uint32_t idx) {
+	return idx >= e->first && idx - e->first < e->cnt;
+}
+
+/* Copies INODE's hint, extent *IDX of its extents, to *E.
+ * Lookups of one inode are not serialized: page faults read
+ * executables and mapped files without the file system lock.  So the
+ * hint is only copied in and out with interrupts off, and used from the
+ * copy. */
+static void
+hint_get (struct inode *inode, size_t *idx, struct extent *e) {
+	enum intr_level old_level = intr_disable ();
+
+	*idx = inode->hint_idx;
+	*e = inode->hint;
+	intr_set_level (old_level);
+}
+
+/* Makes E, extent IDX of INODE's extents, INODE's hint. */
+static void
+hint_set (struct inode *inode, size_t idx, const struct extent *e) {
+	enum intr_level old_level = intr_disable ();
+
+	inode->hint_idx = idx;
+	inode->hint = *e;
+	intr_set_level (old_level);
+}
+
+/* Forgets INODE's last extent found, after its extents changed. */
+static void
+hint_reset (struct inode *inode) {
+	static const struct extent none;
+
+	hint_set (inode, 0, &none);
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * POS.
+ * The extent found is kept as INODE's hint.  Reads near the last one,
+ * and sequential reads running into the next extent, then need no
+ * search, and extents in the spill block are not read again from the
+ * buffer cache. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	const struct inode_disk *disk = &inode->data;
+	uint32_t idx = pos / DISK_SECTOR_SIZE;
+	size_t lo, hi, hint_idx;
+	struct extent e;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= disk->length)
 		return -1;
+
+	/* A hint from before the file grew is still right, only shorter:
+	 * extents are only ever added or lengthened. */
+	hint_get (inode, &hint_idx, &e);
+	if (extent_holds (&e, idx)) {
+		hint_hits++;
+		return e.start + (idx - e.first);
+	}
+	if (e.cnt > 0 && hint_idx + 1 < disk->extent_cnt) {
+		e = extent_get (disk, hint_idx + 1);
+		if (extent_holds (&e, idx)) {
+			hint_hits++;
+			hint_set (inode, hint_idx + 1, &e);
+			return e.start + (idx - e.first);
+		}
+	}
+	hint_misses++;
+
+	/* Find the last extent that starts at or before IDX.  The spill
+	 * block is only read if IDX lies beyond the inode's own extents. */
+	lo = 0;
+	hi = disk->extent_cnt;
+	if (hi > INODE_EXTENTS && idx < disk->extents[INODE_EXTENTS - 1].first
+			+ disk->extents[INODE_EXTENTS - 1].cnt)
+		hi = INODE_EXTENTS;
+	else if (hi > INODE_EXTENTS)
+		lo = INODE_EXTENTS;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (extent_get (disk, mid).first <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = extent_get (disk, lo);
+	ASSERT (extent_holds (&e, idx));
+	hint_set (inode, lo, &e);
+	return e.start + (idx - e.first);
+}
+
+/* Fills CNT sectors starting at SECTOR with zeros. */
+static void
+zero_sectors (disk_sector_t sector, size_t cnt) {
+	static char zeros[DISK_SECTOR_SIZE];
+
+	while (cnt-- > 0)
+		buffer_cache_write (sector++, zeros, 0, DISK_SECTOR_SIZE);
+}
+
+/* Allocates zeroed sectors for DISK until its extents hold SECTORS
+ * sectors.  Each new run goes right after the last extent if those
+ * sectors are free, or else is the longest free run found by halving
+ * the request.  Returns false if the disk or the extent map is full;
+ * what was allocated by then stays in DISK's extents.  The caller
+ * writes DISK back. */
+static bool
+extents_grow (struct inode_disk *disk, size_t sectors) {
+	size_t have = extents_size (disk);
+
+	while (have < sectors) {
+		size_t want = sectors - have;
+		struct extent e;
+		size_t cnt;
+
+		if (disk->extent_cnt > 0) {
+			e = extent_get (disk, disk->extent_cnt - 1);
+			cnt = free_map_extend (e.start + e.cnt, want);
+			if (cnt > 0) {
+				zero_sectors (e.start + e.cnt, cnt);
+				e.cnt += cnt;
+				extent_put (disk, disk->extent_cnt - 1, &e);
+				have += cnt;
+				continue;
+			}
+		}
+
+		if (disk->extent_cnt == MAX_EXTENTS)
+			return false;
+		if (disk->extent_cnt == INODE_EXTENTS && disk->spill == 0) {
+			if (!free_map_allocate (1, &disk->spill))
+				return false;
+			zero_sectors (disk->spill, 1);
+		}
+		for (cnt = want; cnt > 0; cnt /= 2)
+			if (free_map_allocate (cnt, &e.start))
+				break;
+		if (cnt == 0) {
+			/* Give back a spill block that holds nothing yet. */
+			if (disk->extent_cnt == INODE_EXTENTS) {
+				free_map_release (disk->spill, 1);
+				disk->spill = 0;
+			}
+			return false;
+		}
+		zero_sectors (e.start, cnt);
+		e.first = have;
+		e.cnt = cnt;
+		/* Lookups run without a lock, see hint_get(), so the extent
+		 * is stored before the count takes it in; storing it in the
+		 * spill block may block. */
+		extent_put (disk, disk->extent_cnt, &e);
+		barrier ();
+		disk->extent_cnt++;
+		have += cnt;
+	}
+	return true;
+}
+
+/* Gives back all of DISK's data sectors and its spill block. */
+static void
+extents_release (struct inode_disk *disk) {
+	size_t i;
+
+	for (i = 0; i < disk->extent_cnt; i++) {
+		struct extent e = extent_get (disk, i);
+		free_map_release (e.start, e.cnt);
+	}
+	if (disk->spill != 0)
+		free_map_release (disk->spill, 1);
+	disk->spill = 0;
+	disk->extent_cnt = 0;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -77,20 +314,13 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
+		if (extents_grow (disk_inode, bytes_to_sectors (length))) {
+			buffer_cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
 			success = true; 
-		} 
+		} else
+			extents_release (disk_inode);
 		free (disk_inode);
 	}
 	return success;
@@ -125,7 +355,8 @@ inode_open (disk_sector_t sector) {
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	hint_reset (inode);
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
 	return inode;
 }
 
@@ -160,8 +391,8 @@ inode_close (struct inode *inode) {
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			extents_release (&inode->data);
+			hint_reset (inode);
 		}
 
 		free (inode); 
@@ -183,7 +414,6 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,46 +430,62 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Has the buffer cache read the sectors holding SIZE bytes of INODE,
+ * starting at OFFSET, in the background.  Stops at the end of INODE. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end = offset + size;
+
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	for (offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE); offset < end;
+			offset += DISK_SECTOR_SIZE)
+		buffer_cache_readahead (byte_to_sector (inode, offset));
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * A write past the end of file extends INODE first; anything between
+ * the old end and OFFSET reads as zeros.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if an error occurs, or 0 if the disk is full. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	if (size > 0 && offset + size > inode_length (inode)) {
+		bool grown = extents_grow (&inode->data,
+				bytes_to_sectors (offset + size));
+
+		/* Growing may have lengthened the hinted extent. */
+		hint_reset (inode);
+
+		/* Sectors allocated before a failure stay with INODE, unused.
+		 * The length goes up only once the extents hold it. */
+		barrier ();
+		if (grown)
+			inode->data.length = offset + size;
+		buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+		if (!grown)
+			return 0;
+	}
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -255,34 +501,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* The cache reads the sector in first if the chunk does not
+		 * cover all of it. */
+		buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_written;
 }
@@ -311,3 +539,10 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Print statistics about sector lookups. */
+void
+inode_print_stats (void) {
+	printf ("Inodes: %lld sector lookups from the last extent, "
+			"%lld searched\n", hint_hits, hint_misses);
+}
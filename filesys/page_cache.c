@@ -1,6 +1,336 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * Every sector the file system reads or writes on filesys_disk, for
+ * inodes, file data, directories, the free map and the FAT, goes
+ * through a cache of BUFFER_CACHE_SIZE sectors.  A sector is found by
+ * its number in a hash table.  When a sector has to be brought in, the
+ * entry to reuse is chosen by a clock hand, which gives entries used
+ * since it last passed a second chance.  Writes only mark an entry
+ * dirty; it goes to disk when it is reused, or in buffer_cache_flush()
+ * from filesys_done().
+ *
+ * cache_lock protects the table and the state of every entry, but it
+ * is not held during disk I/O, when the entry is busy, nor while bytes
+ * are copied to or from the caller, when the entry is pinned: the
+ * caller's buffer may be user memory that faults.  Neither kind of
+ * entry is reused, and a thread that wants a busy entry waits on
+ * cache_cond.  An entry taken for a write of a whole sector is busy
+ * until it is filled, so that write is copied from user memory into a
+ * kernel buffer first; a fault in the copy may need the same sector.
+ *
+ * Files read sequentially ask for the sectors ahead of the reader with
+ * buffer_cache_readahead(), see file.c.  The sectors are queued, and
+ * the "readahead" thread reads them in while the reader goes on.  A
+ * sector read ahead is not marked accessed, so it is among the first
+ * to go if the reader never gets to it. */
 
+#include "filesys/page_cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "lib/kernel/hash.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+
+#define BUFFER_CACHE_SIZE 64		/* Sectors cached, 32 kB. */
+#define READAHEAD_QUEUE_SIZE 64		/* Sectors waiting to be read ahead. */
+
+/* A cached sector. */
+struct cache_entry {
+	disk_sector_t sector;		/* Sector held, if VALID. */
+	bool valid;					/* In cache_table. */
+	bool dirty;					/* Newer than the disk. */
+	bool accessed;				/* Used since the clock hand passed. */
+	bool busy;					/* Being read, written or filled in. */
+	bool readahead;				/* Read ahead, not asked for yet. */
+	int pin_cnt;				/* # of copies in or out under way. */
+	struct hash_elem elem;		/* Element in cache_table. */
+	uint8_t *data;				/* DISK_SECTOR_SIZE bytes. */
+};
+
+static struct cache_entry *cache;
+static struct hash cache_table;
+static size_t clock_hand;
+static struct lock cache_lock;
+static struct condition cache_cond;	/* An entry may have become free. */
+
+/* Sectors to read ahead, also under cache_lock. */
+static disk_sector_t readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head, readahead_tail;
+static struct condition readahead_cond;	/* The queue is not empty. */
+
+static long long hit_cnt;			/* # of lookups that found the sector. */
+static long long miss_cnt;			/* # of lookups that did not. */
+static long long write_back_cnt;	/* # of dirty sectors written. */
+static long long readahead_cnt;		/* # of sectors read ahead. */
+static long long readahead_hit_cnt;	/* # of those asked for later. */
+static long long readahead_drop_cnt;	/* # of requests the queue had no
+									   room for. */
+
+static void readahead_daemon (void *aux);
+
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct cache_entry, elem)->sector);
+}
+
+static bool
+cache_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct cache_entry, elem)->sector
+		< hash_entry (b, struct cache_entry, elem)->sector;
+}
+
+/* Sets up an empty cache.  Called by filesys_init(). */
+void
+buffer_cache_init (void) {
+	uint8_t *data;
+	size_t i;
+
+	cache = calloc (BUFFER_CACHE_SIZE, sizeof *cache);
+	data = malloc (BUFFER_CACHE_SIZE * DISK_SECTOR_SIZE);
+	if (cache == NULL || data == NULL)
+		PANIC ("buffer_cache_init : out of memory");
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+		cache[i].data = data + i * DISK_SECTOR_SIZE;
+	hash_init (&cache_table, cache_hash, cache_less, NULL);
+	lock_init (&cache_lock);
+	cond_init (&cache_cond);
+	cond_init (&readahead_cond);
+	if (thread_create ("readahead", PRI_DEFAULT, readahead_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("buffer_cache_init : cannot start read-ahead thread");
+}
+
+/* Returns the entry holding SECTOR, or NULL. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&cache_table, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Returns an entry that may be reused, or NULL if all of them are in
+ * use. */
+static struct cache_entry *
+cache_victim (void) {
+	size_t i;
+
+	for (i = 0; i < 2 * BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[clock_hand];
+
+		clock_hand = (clock_hand + 1) % BUFFER_CACHE_SIZE;
+		if (e->busy || e->pin_cnt > 0)
+			continue;
+		if (!e->valid || !e->accessed)
+			return e;
+		e->accessed = false;
+	}
+	return NULL;
+}
+
+/* Writes E, which is dirty and not in use, to disk.  Drops cache_lock
+ * meanwhile. */
+static void
+cache_write_back (struct cache_entry *e) {
+	ASSERT (e->valid && e->dirty && !e->busy && e->pin_cnt == 0);
+
+	e->busy = true;
+	e->dirty = false;
+	lock_release (&cache_lock);
+	disk_write (filesys_disk, e->sector, e->data);
+	lock_acquire (&cache_lock);
+	e->busy = false;
+	write_back_cnt++;
+	cond_broadcast (&cache_cond, &cache_lock);
+}
+
+/* Returns the entry for SECTOR, pinned, after reading the sector in if
+ * it was not cached and FILL is true.  Without FILL the caller is
+ * about to overwrite the whole sector from kernel memory, and an entry
+ * just taken for it stays busy until cache_put().  DEMAND is false for
+ * read-ahead, which does not count as a hit or miss, nor as a use of
+ * the entry. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool fill, bool demand) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	for (;;) {
+		e = cache_lookup (sector);
+		if (e != NULL) {
+			if (e->busy) {
+				cond_wait (&cache_cond, &cache_lock);
+				continue;
+			}
+			if (demand) {
+				hit_cnt++;
+				if (e->readahead)
+					readahead_hit_cnt++;
+				e->readahead = false;
+			}
+			break;
+		}
+
+		e = cache_victim ();
+		if (e == NULL) {
+			cond_wait (&cache_cond, &cache_lock);
+			continue;
+		}
+		if (e->dirty) {
+			/* SECTOR may come in meanwhile, so look again. */
+			cache_write_back (e);
+			continue;
+		}
+
+		if (e->valid)
+			hash_delete (&cache_table, &e->elem);
+		e->sector = sector;
+		e->valid = true;
+		hash_insert (&cache_table, &e->elem);
+		e->busy = true;
+		e->readahead = !demand;
+		if (demand)
+			miss_cnt++;
+		else
+			readahead_cnt++;
+		if (fill) {
+			lock_release (&cache_lock);
+			disk_read (filesys_disk, sector, e->data);
+			lock_acquire (&cache_lock);
+			e->busy = false;
+			cond_broadcast (&cache_cond, &cache_lock);
+		}
+		break;
+	}
+	if (demand)
+		e->accessed = true;
+	e->pin_cnt++;
+	lock_release (&cache_lock);
+	return e;
+}
+
+/* Unpins E, which the caller wrote to if DIRTY. */
+static void
+cache_put (struct cache_entry *e, bool dirty) {
+	lock_acquire (&cache_lock);
+	if (dirty)
+		e->dirty = true;
+	e->pin_cnt--;
+	/* Only cache_get() without FILL hands out an entry busy. */
+	e->busy = false;
+	cond_broadcast (&cache_cond, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes, starting at byte OFS of SECTOR, into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true, true);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e, false);
+}
+
+/* Copies SIZE bytes from BUFFER to byte OFS of SECTOR.  The sector
+ * reaches the disk later. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, off_t ofs,
+		size_t size) {
+	bool fill = ofs > 0 || size < DISK_SECTOR_SIZE;
+	void *bounce = NULL;
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	/* Copy user memory before the entry is busy; without a kernel
+	 * buffer, read the sector in and copy into the pinned entry. */
+	if (!fill && is_user_vaddr (buffer)) {
+		bounce = malloc (DISK_SECTOR_SIZE);
+		if (bounce != NULL) {
+			memcpy (bounce, buffer, DISK_SECTOR_SIZE);
+			buffer = bounce;
+		} else
+			fill = true;
+	}
+
+	e = cache_get (sector, fill, true);
+	memcpy (e->data + ofs, buffer, size);
+	cache_put (e, true);
+	free (bounce);
+}
+
+/* Has SECTOR read into the cache in the background, unless it is
+ * there already.  The request is dropped if too many are waiting. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (cache_lookup (sector) == NULL) {
+		if (readahead_head - readahead_tail < READAHEAD_QUEUE_SIZE) {
+			readahead_queue[readahead_head++ % READAHEAD_QUEUE_SIZE] = sector;
+			cond_signal (&readahead_cond, &cache_lock);
+		} else
+			readahead_drop_cnt++;
+	}
+	lock_release (&cache_lock);
+}
+
+/* Reads in the sectors queued by buffer_cache_readahead(). */
+static void
+readahead_daemon (void *aux UNUSED) {
+	for (;;) {
+		disk_sector_t sector;
+
+		lock_acquire (&cache_lock);
+		while (readahead_head == readahead_tail)
+			cond_wait (&readahead_cond, &cache_lock);
+		sector = readahead_queue[readahead_tail++ % READAHEAD_QUEUE_SIZE];
+		lock_release (&cache_lock);
+
+		cache_put (cache_get (sector, true, false), false);
+	}
+}
+
+/* Writes every dirty sector to disk. */
+void
+buffer_cache_flush (void) {
+	size_t i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		while (e->busy || e->pin_cnt > 0)
+			cond_wait (&cache_cond, &cache_lock);
+		if (e->dirty)
+			cache_write_back (e);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Print statistics about the buffer cache. */
+void
+buffer_cache_print_stats (void) {
+	long long lookup_cnt = hit_cnt + miss_cnt;
+
+	printf ("Buffer cache: %lld hits, %lld misses (%lld%% hit), "
+			"%lld sectors written back\n", hit_cnt, miss_cnt,
+			lookup_cnt > 0 ? hit_cnt * 100 / lookup_cnt : 0, write_back_cnt);
+	printf ("Read-ahead: %lld sectors read, %lld of them used, "
+			"%lld requests dropped\n", readahead_cnt, readahead_hit_cnt,
+			readahead_drop_cnt);
+}
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
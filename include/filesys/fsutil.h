@@ -6,5 +6,8 @@ void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
 void fsutil_put (char **argv);
 void fsutil_get (char **argv);
+#ifdef EFILESYS
+void fsutil_fat_bench (char **argv);
+#endif
 
 #endif /* filesys/fsutil.h */
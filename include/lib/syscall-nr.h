@@ -36,6 +36,23 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Project 3 extensions, numbered after the rest so that existing
+	 * binaries keep working. */
+	SYS_MADVISE,                /* Advise on the use of a memory range. */
+	SYS_MSYNC,                  /* Write back a memory mapping. */
 };
 
+/* Advice for SYS_MADVISE. */
+#define MADV_NORMAL 0               /* No special treatment. */
+#define MADV_RANDOM 1               /* Random access: no read-ahead. */
+#define MADV_SEQUENTIAL 2           /* Sequential access: read ahead far,
+                                       evict what is behind early. */
+#define MADV_WILLNEED 3             /* Start reading the pages in. */
+#define MADV_DONTNEED 4             /* Free the pages and their swap. */
+
+/* Flag for the WRITABLE argument of SYS_MMAP: read the whole mapping
+ * in before returning. */
+#define MAP_POPULATE 0x10
+
 #endif /* lib/syscall-nr.h */
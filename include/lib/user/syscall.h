@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <syscall-nr.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -41,6 +42,8 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -78,4 +81,12 @@ get_fs_disk_write_cnt (void) {
 	return write_cnt;
 }
 
+/* Writes to the swap disk (hd1:1) so far. */
+static inline long long
+get_swap_disk_write_cnt (void) {
+	long long write_cnt;
+	asm volatile ("int $0x44" : "=a" (write_cnt) : "d" (1), "c" (1));
+	return write_cnt;
+}
+
 #endif /* lib/user/syscall.h */
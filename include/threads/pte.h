@@ -41,5 +41,11 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=2 MiB page (PDEs only). */
+#define PTE_G 0x100                      /* 1=global, kept across CR3 loads. */
+
+/* A huge page is mapped by a single page directory entry. */
+#define HPAGE_SIZE (1UL << PDXSHIFT)     /* Bytes in a huge page. */
+#define HPAGE_CNT (HPAGE_SIZE / PGSIZE)  /* Pages in a huge page. */
 
 #endif /* threads/pte.h */
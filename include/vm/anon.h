@@ -1,10 +1,17 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include <stddef.h>
 #include "devices/disk.h"
 struct page;
+struct supplemental_page_table;
 enum vm_type;
 
+/* Most pages moved to or from swap in one disk transfer. */
+#define SWAP_CLUSTER 8
+
+extern size_t swap_readahead;
+
 struct anon_page {
     vm_initializer *init;
 	enum vm_type type;
@@ -12,6 +19,8 @@ struct anon_page {
 	/* Initiate the struct page and maps the pa to the va */
 	bool (*page_initializer) (struct page *, enum vm_type, void *kva);
 	disk_sector_t swap_slot;
+	struct zswap_entry *zswap;	/* Compressed copy, if not on disk. */
+	bool clean;					/* Still as read from the executable. */
 };
 
 // struct swap_table {
@@ -20,5 +29,9 @@ struct anon_page {
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_swap_out_cluster (struct page *pages[], size_t cnt);
+bool anon_swap_has_room (size_t cnt);
+void anon_free_dead_slots (struct supplemental_page_table *spt);
+void vm_anon_print_stats (void);
 
 #endif
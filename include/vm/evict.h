@@ -0,0 +1,17 @@
+#ifndef VM_EVICT_H
+#define VM_EVICT_H
+#include <stdbool.h>
+
+struct frame;
+
+bool evict_select (const char *name);
+const char *evict_policy_name (void);
+long long evict_ghost_hits (void);
+
+void evict_init (void);
+void evict_install (struct frame *frame);
+void evict_remove (struct frame *frame);
+void evict_deactivate (struct frame *frame);
+struct frame *evict_victim (void);
+
+#endif  /* VM_EVICT_H */
@@ -16,6 +16,8 @@ struct file_page {
 
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+bool file_backed_writeback (struct page *pages[], size_t cnt);
+void vm_file_print_stats (void);
 // void *do_mmap(void *addr, size_t length, int writable,
 		// struct file *file, off_t offset);
 // void do_munmap (struct page *page);
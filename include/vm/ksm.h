@@ -0,0 +1,17 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stddef.h>
+
+struct frame;
+
+/* Frames looked at by the merging thread every KSM_INTERVAL ticks.  0
+ * leaves same-page merging off. */
+extern size_t ksm_scan_rate;
+
+void ksm_init (struct frame *zero);
+void ksm_scan (struct frame *frame);
+void ksm_pass_done (void);
+void ksm_forget (struct frame *frame);
+void ksm_print_stats (void);
+
+#endif  /* VM_KSM_H */
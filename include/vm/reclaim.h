@@ -0,0 +1,14 @@
+#ifndef VM_RECLAIM_H
+#define VM_RECLAIM_H
+#include <stddef.h>
+
+/* Free user frames below which the reclaim daemon wakes up, and up to
+ * which it then frees frames.  SIZE_MAX picks a default from the size
+ * of the user pool; a low watermark of 0 disables the daemon. */
+extern size_t reclaim_low_wm;
+extern size_t reclaim_high_wm;
+
+void reclaim_init (void);
+void reclaim_wake (void);
+
+#endif  /* VM_RECLAIM_H */
@@ -0,0 +1,20 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returned by swap_alloc() when there is no free run long enough. */
+#define SWAP_ERROR SIZE_MAX
+
+bool swap_add (const char *spec);
+void swap_init (void);
+size_t swap_alloc (size_t cnt);
+void swap_free (size_t slot, size_t cnt);
+size_t swap_slot_cnt (void);
+size_t swap_free_cnt (void);
+size_t swap_dev_end (size_t slot);
+void swap_transfer (size_t slot, void *const kvas[], size_t cnt, bool write);
+void swap_print_stats (void);
+
+#endif  /* VM_SWAP_H */
@@ -0,0 +1,16 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+#include <stdbool.h>
+
+struct page;
+struct frame;
+
+void text_init (void);
+bool text_page (struct page *page);
+bool exec_page_clean (struct page *page);
+struct frame *text_find (struct page *page);
+void text_insert (struct page *page, struct frame *frame);
+void text_remove (struct frame *frame);
+long long text_hits (void);
+
+#endif  /* VM_TEXT_H */
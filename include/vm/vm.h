@@ -2,6 +2,7 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "filesys/off_t.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -52,6 +53,11 @@ struct page {
 	struct hash_elem		hash_elem;
 	bool					writable;
 	uint64_t				stack_bottom;
+	struct thread			*owner;		/* Thread whose spt holds this page. */
+	struct list_elem		frame_elem;	/* Element in frame->pages. */
+	bool					busy;		/* Being read in or written out. */
+	bool					prefetch;	/* Queued by MADV_WILLNEED. */
+	struct list_elem		prefetch_elem;	/* Element in the prefetch queue. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -65,11 +71,38 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * There is one for every page of the user pool, in a table indexed by
+ * frame number; see vm_frame_lookup().  KVA is null while the frame is
+ * free.
+ * After fork, a frame may be shared copy-on-write by several pages, all
+ * of them mapped read-only.  PAGES is the reverse map: each page in it
+ * gives the pml4 (page->owner) and address (page->va) of one mapping,
+ * so any process's frame can be unmapped and evicted.  PAGE, the owner,
+ * is any one of them. */
 struct frame {
 	void *kva;
 	struct page *page;
-	struct list_elem f_elem;
+	struct list pages;		/* Every page mapping this frame. */
+	int ref_cnt;			/* Length of PAGES. */
+	int pin_cnt;			/* Off the eviction queues while > 0. */
+	bool dirty;				/* Written through a mapping now gone. */
+	bool accessed;			/* Accessed through a mapping now gone. */
+	struct list_elem f_elem;	/* Element in an eviction queue. */
+	int queue;				/* Which queue, see vm/evict.c. */
+
+	/* Shared program text, see vm/text.c.  TEXT_INODE is null if the
+	 * frame is not in the text cache. */
+	struct hash_elem text_elem;
+	struct inode *text_inode;
+	off_t text_ofs;
+	size_t text_bytes;
+
+	/* Same-page merging, see vm/ksm.c. */
+	int ksm_state;				/* Which table it is in, if any. */
+	uint64_t ksm_sum;			/* Checksum when last looked at. */
+	struct hash_elem ksm_elem;	/* Element in the stable table. */
+	struct list_elem ksm_list_elem;	/* Element in an unstable list. */
 };
 
 /* The function table for page operations.
@@ -88,11 +121,28 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* A run of sequential faults, tracked for fault-around. */
+struct fault_stream {
+	void *next;				/* Fault that continues the run. */
+	unsigned seq;			/* Faults that have continued it. */
+	size_t window;			/* Pages populated by the last one. */
+};
+
+#define FAULT_STREAM_CNT 4	/* Runs tracked per process. */
+
 /* Representation of current process's memory space.
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
-	struct hash h;
+	struct hash h;				/* Pages touched so far. */
+	struct vma **vmas;			/* Regions, sorted, see vm/vma.c. */
+	size_t vma_cnt;
+	size_t vma_cap;
+	struct fault_stream streams[FAULT_STREAM_CNT];
+	unsigned stream_next;	/* Stream to replace next. */
+	bool dying;				/* Being torn down at exit. */
+	size_t dead_slot;		/* Swap slots freed while dying but */
+	size_t dead_slot_cnt;	/* not yet given back, see anon.c. */
 };
 
 #include "threads/thread.h"
@@ -102,8 +152,19 @@ bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 void supplemental_page_table_kill (struct supplemental_page_table *spt);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
+struct page *spt_lookup_page (struct supplemental_page_table *spt,
+		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+void spt_unmap (struct supplemental_page_table *spt, void *addr);
+bool spt_advise (struct supplemental_page_table *spt, void *addr,
+		size_t length, int advice);
+void spt_populate (struct supplemental_page_table *spt, void *addr,
+		size_t length);
+bool spt_msync (struct supplemental_page_table *spt, void *addr,
+		size_t length);
+
+extern bool vm_huge_pages;
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -115,7 +176,20 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+void vm_free_frame (struct page *page);
+struct frame *vm_claim_spare_frame (struct page *page);
+void vm_install_spare_frame (struct page *page);
+void vm_release_spare_frame (struct page *page);
+struct frame *vm_frame_lookup (void *kva);
+void vm_frame_merge (struct frame *from, struct frame *into);
+void vm_ksm_scan (size_t cnt);
+void vm_page_set_busy (struct page *page, bool busy);
+void vm_io_begin (void);
+void vm_io_end (void);
+bool vm_frame_clear_dirty (struct frame *frame);
+size_t vm_reclaim (void);
 enum vm_type page_get_type (struct page *page);
+void vm_print_stats (void);
 
 void print_spt(void);
 
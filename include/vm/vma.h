@@ -0,0 +1,38 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm/vm.h"
+
+struct file;
+
+/* A region of a process's address space: an ELF segment, a file
+ * mapping or the stack.  A page inside a region gets its struct page
+ * only when it is first looked up, see spt_find_page(). */
+struct vma {
+	void *start;			/* First page. */
+	void *end;				/* Page after the last one. */
+	enum vm_type type;		/* Type of its pages. */
+	bool writable;
+	vm_initializer *init;	/* Loads a page, or NULL for zeros. */
+	struct file *file;		/* Backing file, or NULL. */
+	off_t ofs;				/* Offset of START in FILE. */
+	size_t read_bytes;		/* Bytes of FILE mapped, then zeros. */
+	int advice;				/* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+};
+
+void vma_init (struct supplemental_page_table *spt);
+struct vma *vma_add (struct supplemental_page_table *spt, void *start,
+		size_t page_cnt, enum vm_type type, bool writable,
+		vm_initializer *init, struct file *file, off_t ofs,
+		size_t read_bytes);
+struct vma *vma_find (struct supplemental_page_table *spt, const void *va);
+int vma_advice (struct page *page);
+bool vma_grow_down (struct supplemental_page_table *spt, struct vma *vma,
+		void *start);
+void vma_remove (struct supplemental_page_table *spt, struct vma *vma);
+bool vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src);
+void vma_kill (struct supplemental_page_table *spt);
+
+#endif  /* VM_VMA_H */
@@ -0,0 +1,18 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stddef.h>
+
+struct zswap_entry;
+
+/* Most bytes of compressed pages kept in memory, in pages.  SIZE_MAX
+ * picks a default from the size of the user pool; 0 disables the
+ * compressed cache. */
+extern size_t zswap_limit;
+
+void zswap_init (void);
+struct zswap_entry *zswap_store (const void *kva);
+void zswap_load (struct zswap_entry *e, void *kva);
+void zswap_free (struct zswap_entry *e);
+void zswap_print_stats (long long disk_in_cnt);
+
+#endif  /* VM_ZSWAP_H */
@@ -0,0 +1,46 @@
+/* Writes a file twice the size of the buffer cache one byte at a time,
+   then reads it back the same way, and checks that the disk sees about
+   one write and one read per sector rather than one per byte. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#define TEST_SIZE (64 * 1024)
+#define SECTOR_CNT (TEST_SIZE / 512)
+
+static const char file_name[] = "data";
+
+void
+test_main (void) {
+  int fd, i;
+  char c;
+  long long read_cnt, write_cnt;
+
+  CHECK (create (file_name, TEST_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  read_cnt = get_fs_disk_read_cnt ();
+  write_cnt = get_fs_disk_write_cnt ();
+  for (i = 0; i < TEST_SIZE; i++) {
+    c = i % 251;
+    if (write (fd, &c, 1) != 1)
+      fail ("write failed at byte %d", i);
+  }
+  msg ("write \"%s\" byte by byte", file_name);
+
+  seek (fd, 0);
+  for (i = 0; i < TEST_SIZE; i++) {
+    if (read (fd, &c, 1) != 1 || c != (char) (i % 251))
+      fail ("file content mismatch at byte %d", i);
+  }
+  msg ("read \"%s\" byte by byte", file_name);
+
+  CHECK (get_fs_disk_write_cnt () - write_cnt <= 2 * SECTOR_CNT,
+         "check write_cnt");
+  CHECK (get_fs_disk_read_cnt () - read_cnt <= 3 * SECTOR_CNT,
+         "check read_cnt");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-coalesce) begin
+(bc-coalesce) create "data"
+(bc-coalesce) open "data"
+(bc-coalesce) write "data" byte by byte
+(bc-coalesce) read "data" byte by byte
+(bc-coalesce) check write_cnt
+(bc-coalesce) check read_cnt
+(bc-coalesce) close "data"
+(bc-coalesce) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Writes a file that fits in the buffer cache, then reads it twice and
+   checks that the second pass is served without reading the disk. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#define TEST_SIZE (16 * 1024)
+
+static const char file_name[] = "data";
+static char buf[TEST_SIZE];
+static char check[TEST_SIZE];
+
+void
+test_main (void) {
+  int fd;
+  long long read_cnt;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == TEST_SIZE, "write \"%s\"", file_name);
+
+  seek (fd, 0);
+  CHECK (read (fd, check, sizeof check) == TEST_SIZE, "read \"%s\"", file_name);
+  if (memcmp (buf, check, sizeof buf))
+    fail ("file content mismatch on first read");
+
+  read_cnt = get_fs_disk_read_cnt ();
+  seek (fd, 0);
+  CHECK (read (fd, check, sizeof check) == TEST_SIZE,
+         "read \"%s\" again", file_name);
+  if (memcmp (buf, check, sizeof buf))
+    fail ("file content mismatch on second read");
+  CHECK (get_fs_disk_read_cnt () == read_cnt, "check read_cnt");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
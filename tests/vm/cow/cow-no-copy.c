@@ -0,0 +1,39 @@
+/* Dirties more than half of user memory, then forks.  Copying the
+   parent at fork time would not fit and would have to go through the
+   swap disk; with copy-on-write the fork and a read-only child write
+   nothing to swap at all. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (6 * 1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+	long long writes;
+	pid_t child;
+	size_t i;
+
+	msg ("dirty 6 MB");
+	memset (buf, 0x5a, sizeof buf);
+	writes = get_swap_disk_write_cnt ();
+
+	child = fork ("child");
+	if (child == 0) {
+		for (i = 0; i < SIZE; i += PAGE_SIZE)
+			if (buf[i] != 0x5a)
+				fail ("byte %zu != 0x5a", i);
+		msg ("child read pass");
+		return;
+	}
+	wait (child);
+	CHECK (get_swap_disk_write_cnt () == writes, "fork wrote nothing to swap");
+}
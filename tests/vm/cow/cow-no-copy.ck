@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-no-copy) begin
+(cow-no-copy) dirty 6 MB
+(cow-no-copy) child read pass
+(cow-no-copy) end
+(cow-no-copy) fork wrote nothing to swap
+(cow-no-copy) end
+EOF
+pass;
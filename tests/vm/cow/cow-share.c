@@ -0,0 +1,47 @@
+/* Forks a process with many resident pages and checks that the child
+   shares every one of them with its parent, so that the fork itself
+   takes no new frames.  Only the page the child writes gets copied. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+static void *pa[PAGE_CNT];
+
+void
+test_main (void)
+{
+	pid_t child;
+	int i, shared;
+
+	for (i = 0; i < PAGE_CNT; i++) {
+		buf[i * PAGE_SIZE] = 'a';
+		pa[i] = get_phys_addr (&buf[i * PAGE_SIZE]);
+	}
+	msg ("touch %d pages", PAGE_CNT);
+
+	child = fork ("child");
+	if (child == 0) {
+		shared = 0;
+		for (i = 0; i < PAGE_CNT; i++)
+			if (get_phys_addr (&buf[i * PAGE_SIZE]) == pa[i])
+				shared++;
+		CHECK (shared == PAGE_CNT, "child shares all %d pages", PAGE_CNT);
+
+		buf[0] = '@';
+		CHECK (get_phys_addr (&buf[0]) != pa[0], "write copies page 0");
+		CHECK (get_phys_addr (&buf[PAGE_SIZE]) == pa[1],
+				"page 1 is still shared");
+		return;
+	}
+	wait (child);
+	CHECK (buf[0] == 'a', "parent's page 0 is unchanged");
+	CHECK (get_phys_addr (&buf[0]) == pa[0], "parent kept its frame");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-share) begin
+(cow-share) touch 64 pages
+(cow-share) child shares all 64 pages
+(cow-share) write copies page 0
+(cow-share) page 1 is still shared
+(cow-share) end
+(cow-share) parent's page 0 is unchanged
+(cow-share) parent kept its frame
+(cow-share) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Touches a 2 MiB aligned array with -hugepages on and checks that it
+   is backed by one physically contiguous run of frames, then forks so
+   that write-protecting the array splits the huge page, and checks
+   that both processes still see the right data. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define HUGE_SIZE (2 * 1024 * 1024)
+#define PAGE_CNT (HUGE_SIZE / PAGE_SIZE)
+
+static char buf[HUGE_SIZE] __attribute__ ((aligned (HUGE_SIZE)));
+
+void
+test_main (void)
+{
+	uint8_t *base;
+	pid_t child;
+	int i;
+
+	buf[0] = 1;
+	base = get_phys_addr (buf);
+	for (i = 1; i < PAGE_CNT; i++)
+		if (get_phys_addr (&buf[i * PAGE_SIZE]) != base + i * PAGE_SIZE)
+			fail ("page %d is not contiguous with page 0", i);
+	msg ("array is one contiguous run");
+
+	for (i = 0; i < PAGE_CNT; i++)
+		buf[i * PAGE_SIZE] = i;
+	msg ("write %d pages", PAGE_CNT);
+
+	child = fork ("child");
+	if (child == 0) {
+		for (i = 0; i < PAGE_CNT; i++)
+			if (buf[i * PAGE_SIZE] != (char) i)
+				fail ("child: page %d is wrong", i);
+		buf[PAGE_SIZE] = 'c';
+		CHECK (buf[PAGE_SIZE] == 'c' && buf[0] == 0,
+				"child write copies one page");
+		return;
+	}
+	wait (child);
+	for (i = 0; i < PAGE_CNT; i++)
+		if (buf[i * PAGE_SIZE] != (char) i)
+			fail ("parent: page %d is wrong", i);
+	msg ("parent's pages are unchanged");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(huge-page) begin
+(huge-page) array is one contiguous run
+(huge-page) write 512 pages
+(huge-page) child write copies one page
+(huge-page) end
+(huge-page) parent's pages are unchanged
+(huge-page) end
+EOF
+pass;
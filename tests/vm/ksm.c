@@ -0,0 +1,60 @@
+/* Fills a few pages with the same bytes and blocks on reads from the
+   disk, with -ksm on, until the merging thread gets them to share a
+   frame.  Then writes to one of them and checks that it gets a copy of
+   its own while the others keep their contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+#define TRIES 10000
+
+static char buf[PAGE_CNT][PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Returns whether all pages of BUF are in one frame. */
+static bool
+merged (void)
+{
+	int i;
+
+	for (i = 1; i < PAGE_CNT; i++)
+		if (get_phys_addr (buf[i]) != get_phys_addr (buf[0]))
+			return false;
+	return true;
+}
+
+void
+test_main (void)
+{
+	char block[512];
+	int fd, i, j;
+
+	for (i = 0; i < PAGE_CNT; i++)
+		for (j = 0; j < PAGE_SIZE; j++)
+			buf[i][j] = j % 251;
+	msg ("fill %d pages", PAGE_CNT);
+
+	CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+	for (i = 0; i < TRIES && !merged (); i++) {
+		seek (fd, 0);
+		read (fd, block, sizeof block);
+	}
+	close (fd);
+	if (i == TRIES)
+		fail ("pages were not merged");
+	msg ("pages share one frame");
+
+	buf[1][0] = 'x';
+	CHECK (get_phys_addr (buf[1]) != get_phys_addr (buf[0]),
+			"write gets a private copy");
+	for (i = 0; i < PAGE_CNT; i++)
+		for (j = 0; j < PAGE_SIZE; j++)
+			if (buf[i][j] != (i == 1 && j == 0 ? 'x' : (char) (j % 251)))
+				fail ("page %d, byte %d is wrong", i, j);
+	msg ("contents are intact");
+}
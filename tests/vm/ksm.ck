@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm) begin
+(ksm) fill 4 pages
+(ksm) open "sample.txt"
+(ksm) pages share one frame
+(ksm) write gets a private copy
+(ksm) contents are intact
+(ksm) end
+EOF
+pass;
@@ -0,0 +1,67 @@
+/* Checks madvise() and mmap() with MAP_POPULATE: a populated mapping
+   is resident before it is touched, MADV_DONTNEED frees pages, which
+   come back as zeros or as the file's contents, and the other advice
+   leaves the contents alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 16
+#define SIZE (PAGE_CNT * PAGE_SIZE)
+#define ACTUAL ((void *) 0x10000000)
+
+static char anon[SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+static char file[SIZE];
+
+void
+test_main (void)
+{
+	char *map;
+	int handle;
+	int i;
+
+	memset (anon, 'a', SIZE);
+	CHECK (madvise (anon, SIZE, MADV_DONTNEED) == 0, "madvise DONTNEED");
+	for (i = 0; i < SIZE; i++)
+		if (anon[i] != 0)
+			fail ("byte %d is not zero", i);
+	msg ("anonymous pages come back zeroed");
+
+	CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+	CHECK (read (handle, file, SIZE) == SIZE, "read \"large.txt\"");
+	CHECK ((map = mmap (ACTUAL, SIZE, MAP_POPULATE, handle, 0)) != MAP_FAILED,
+			"mmap \"large.txt\" with MAP_POPULATE");
+	for (i = 0; i < PAGE_CNT; i++)
+		if (get_phys_addr (map + i * PAGE_SIZE) == NULL)
+			fail ("page %d is not resident", i);
+	msg ("populated pages are resident");
+	if (memcmp (map, file, SIZE))
+		fail ("populated mapping does not match file");
+
+	CHECK (madvise (map, SIZE, MADV_DONTNEED) == 0, "madvise DONTNEED");
+	if (get_phys_addr (map) != NULL)
+		fail ("page 0 is still resident");
+	if (memcmp (map, file, SIZE))
+		fail ("mapping does not match file after DONTNEED");
+	msg ("file pages come back from the file");
+
+	CHECK (madvise (map, SIZE, MADV_DONTNEED) == 0, "madvise DONTNEED");
+	CHECK (madvise (map, SIZE, MADV_SEQUENTIAL) == 0, "madvise SEQUENTIAL");
+	CHECK (madvise (map, SIZE, MADV_WILLNEED) == 0, "madvise WILLNEED");
+	if (memcmp (map, file, SIZE))
+		fail ("mapping does not match file after WILLNEED");
+	CHECK (madvise (map, SIZE, MADV_RANDOM) == 0, "madvise RANDOM");
+	if (memcmp (map, file, SIZE))
+		fail ("mapping does not match file after RANDOM");
+	msg ("advised mapping matches file");
+
+	CHECK (madvise (map + SIZE * 1024, PAGE_SIZE, MADV_WILLNEED) == -1,
+			"madvise on unmapped memory fails");
+	CHECK (madvise (map, PAGE_SIZE, 99) == -1, "unknown advice fails");
+
+	munmap (map);
+	close (handle);
+}
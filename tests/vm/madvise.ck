@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) madvise DONTNEED
+(madvise) anonymous pages come back zeroed
+(madvise) open "large.txt"
+(madvise) read "large.txt"
+(madvise) mmap "large.txt" with MAP_POPULATE
+(madvise) populated pages are resident
+(madvise) madvise DONTNEED
+(madvise) file pages come back from the file
+(madvise) madvise DONTNEED
+(madvise) madvise SEQUENTIAL
+(madvise) madvise WILLNEED
+(madvise) madvise RANDOM
+(madvise) advised mapping matches file
+(madvise) madvise on unmapped memory fails
+(madvise) unknown advice fails
+(madvise) end
+EOF
+pass;
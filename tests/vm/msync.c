@@ -0,0 +1,55 @@
+/* Writes to several pages of a file through a mapping, and checks that
+   msync() puts the changes in the file while the mapping stays in
+   place, and that munmap() writes back the changes made after it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 8
+#define SIZE (PAGE_CNT * PAGE_SIZE)
+#define ACTUAL ((void *) 0x10000000)
+
+static char expected[SIZE];
+static char file[SIZE];
+
+/* Checks that the file open as HANDLE holds EXPECTED. */
+static void
+compare_file (int handle, const char *when)
+{
+  seek (handle, 0);
+  CHECK (read (handle, file, SIZE) == SIZE, "read back %s", when);
+  if (memcmp (file, expected, SIZE))
+    fail ("file does not match mapping %s", when);
+}
+
+void
+test_main (void)
+{
+  int handle;
+  char *map;
+  int i;
+
+  CHECK (create ("msync.txt", SIZE), "create \"msync.txt\"");
+  CHECK ((handle = open ("msync.txt")) > 1, "open \"msync.txt\"");
+  CHECK ((map = mmap (ACTUAL, SIZE, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"msync.txt\"");
+
+  /* Pages 0 to 3 are one run, pages 5 and 7 are on their own. */
+  for (i = 0; i < PAGE_CNT; i++)
+    if (i < 4 || i == 5 || i == 7)
+      memset (map + i * PAGE_SIZE, 'a' + i, PAGE_SIZE);
+  memcpy (expected, map, SIZE);
+  CHECK (msync (map, SIZE) == 0, "msync");
+  compare_file (handle, "after msync");
+
+  memset (map + 2 * PAGE_SIZE, 'x', PAGE_SIZE);
+  memcpy (expected, map, SIZE);
+  munmap (map);
+  compare_file (handle, "after munmap");
+
+  CHECK (msync (ACTUAL, SIZE) == -1, "msync after munmap fails");
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(msync) begin
+(msync) create "msync.txt"
+(msync) open "msync.txt"
+(msync) mmap "msync.txt"
+(msync) msync
+(msync) read back after msync
+(msync) read back after munmap
+(msync) msync after munmap fails
+(msync) end
+EOF
+pass;
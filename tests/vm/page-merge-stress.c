@@ -0,0 +1,90 @@
+/* Runs more child-sort processes at once than page-merge-par does,
+   each on its own 128 kB chunk of random data, so that many faults,
+   evictions and swap-ins are in flight together.  Then checks that
+   every chunk came back sorted and with the same bytes it had. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE (128 * 1024)
+#define CHUNK_CNT 12                            /* Number of chunks. */
+
+unsigned char buf[CHUNK_SIZE];
+size_t histograms[CHUNK_CNT][256];
+
+/* Writes CHUNK_CNT chunks of random data to files and starts a
+   child-sort on each one, without waiting in between. */
+static void
+sort_chunks (pid_t children[])
+{
+  struct arc4 arc4;
+  size_t i, j;
+
+  arc4_init (&arc4, "foobar", 6);
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      char fn[32];
+      char cmd[64];
+      int handle;
+
+      arc4_crypt (&arc4, buf, sizeof buf);
+      for (j = 0; j < sizeof buf; j++)
+        histograms[i][buf[j]]++;
+
+      snprintf (fn, sizeof fn, "stress%zu", i);
+      quiet = true;
+      CHECK (create (fn, CHUNK_SIZE), "create \"%s\"", fn);
+      CHECK ((handle = open (fn)) > 1, "open \"%s\"", fn);
+      write (handle, buf, CHUNK_SIZE);
+      close (handle);
+
+      snprintf (cmd, sizeof cmd, "child-sort %s", fn);
+      children[i] = fork ("child-sort");
+      if (children[i] == 0)
+        CHECK ((children[i] = exec (cmd)) != -1, "exec \"%s\"", cmd);
+      quiet = false;
+    }
+  msg ("started %d children", CHUNK_CNT);
+}
+
+/* Checks that chunk I is sorted and holds the bytes it was given. */
+static void
+verify_chunk (size_t i)
+{
+  char fn[32];
+  int handle;
+  size_t value, j;
+
+  snprintf (fn, sizeof fn, "stress%zu", i);
+  quiet = true;
+  CHECK ((handle = open (fn)) > 1, "open \"%s\"", fn);
+  CHECK (read (handle, buf, CHUNK_SIZE) == CHUNK_SIZE, "read \"%s\"", fn);
+  close (handle);
+  quiet = false;
+
+  j = 0;
+  for (value = 0; value < 256; value++)
+    while (histograms[i][value]-- > 0)
+      {
+        if (buf[j] != value)
+          fail ("chunk %zu: bad value %d in byte %zu", i, buf[j], j);
+        j++;
+      }
+}
+
+void
+test_main (void)
+{
+  pid_t children[CHUNK_CNT];
+  size_t i;
+
+  sort_chunks (children);
+  for (i = 0; i < CHUNK_CNT; i++)
+    CHECK (wait (children[i]) == 123, "wait for child %zu", i);
+  for (i = 0; i < CHUNK_CNT; i++)
+    verify_chunk (i);
+  msg ("all chunks sorted");
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-merge-stress) begin
+(page-merge-stress) started 12 children
+(page-merge-stress) wait for child 0
+(page-merge-stress) wait for child 1
+(page-merge-stress) wait for child 2
+(page-merge-stress) wait for child 3
+(page-merge-stress) wait for child 4
+(page-merge-stress) wait for child 5
+(page-merge-stress) wait for child 6
+(page-merge-stress) wait for child 7
+(page-merge-stress) wait for child 8
+(page-merge-stress) wait for child 9
+(page-merge-stress) wait for child 10
+(page-merge-stress) wait for child 11
+(page-merge-stress) all chunks sorted
+(page-merge-stress) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Writes to every other page of an initialized data array, then pushes
+   the whole array out of memory by writing a big chunk, and checks
+   that the pages that were never written read back as they were in the
+   executable and the others as they were written.
+   For this test, Pintos memory size is 10MB. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (20 * ONE_MB)
+#define DATA_PAGES 64
+#define DATA_INTS (DATA_PAGES * PAGE_SIZE / sizeof (int))
+#define PATTERN 0x5a5aa5a5
+
+static int data[DATA_INTS] = { [0 ... DATA_INTS - 1] = PATTERN };
+static char big_chunk[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+	size_t i;
+
+	for (i = 0; i < DATA_INTS; i += PAGE_SIZE / sizeof (int))
+		if (i / (PAGE_SIZE / sizeof (int)) % 2)
+			data[i] = i;
+	msg ("write every other data page");
+
+	for (i = 0; i < CHUNK_SIZE; i += PAGE_SIZE)
+		big_chunk[i] = i / PAGE_SIZE;
+	msg ("write %d MB", CHUNK_SIZE / ONE_MB);
+
+	for (i = 0; i < DATA_INTS; i++) {
+		int expected = i % (PAGE_SIZE / sizeof (int)) == 0
+			&& i / (PAGE_SIZE / sizeof (int)) % 2 ? (int) i : PATTERN;
+		if (data[i] != expected)
+			fail ("data[%zu] is %#x, not %#x", i, data[i], expected);
+	}
+	msg ("data is consistent");
+
+	for (i = 0; i < CHUNK_SIZE; i += PAGE_SIZE)
+		if (big_chunk[i] != (char) (i / PAGE_SIZE))
+			fail ("chunk page %zu is wrong", i / PAGE_SIZE);
+	msg ("chunk is consistent");
+}
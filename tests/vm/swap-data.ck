@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-data) begin
+(swap-data) write every other data page
+(swap-data) write 20 MB
+(swap-data) data is consistent
+(swap-data) chunk is consistent
+(swap-data) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Runs a second instance of this program while the first one waits
+   for it, and checks that the two map the same frame for their
+   code. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "text-share";
+
+int
+main (int argc, char *argv[])
+{
+  uint64_t code = (uint64_t) get_phys_addr ((void *) main);
+  char cmd[64];
+  pid_t child;
+
+  if (argc == 2)
+    {
+      /* Second instance: ARGV[1] is the first one's frame, in hex. */
+      uint64_t first = 0;
+      const char *p;
+
+      for (p = argv[1]; *p != '\0'; p++)
+        first = first * 16 + (*p <= '9' ? *p - '0' : *p - 'a' + 10);
+      CHECK (code == first, "second instance shares the code frame");
+      return 0;
+    }
+
+  msg ("begin");
+  child = fork ("child");
+  if (child == 0)
+    {
+      snprintf (cmd, sizeof cmd, "text-share %llx", code);
+      exec (cmd);
+      fail ("exec failed");
+    }
+  CHECK (wait (child) == 0, "wait for second instance");
+  msg ("end");
+  return 0;
+}
@@ -0,0 +1,39 @@
+/* Reads a large untouched array and checks that all of its pages map
+   the same zero frame, then checks that a write gives only the page
+   written a frame of its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+	void *zero;
+	int i;
+
+	for (i = 0; i < PAGE_CNT; i++)
+		if (buf[i * PAGE_SIZE] != 0)
+			fail ("page %d is not zero", i);
+	msg ("read %d pages", PAGE_CNT);
+
+	zero = get_phys_addr (buf);
+	for (i = 1; i < PAGE_CNT; i++)
+		if (get_phys_addr (&buf[i * PAGE_SIZE]) != zero)
+			fail ("page %d has a frame of its own", i);
+	msg ("all pages map one frame");
+
+	buf[0] = 'a';
+	CHECK (get_phys_addr (buf) != zero, "write gives page 0 a frame");
+	CHECK (buf[0] == 'a' && buf[1] == 0, "page 0 holds the write");
+	CHECK (get_phys_addr (&buf[PAGE_SIZE]) == zero && buf[PAGE_SIZE] == 0,
+			"page 1 still maps the zero frame");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-page) begin
+(zero-page) read 64 pages
+(zero-page) all pages map one frame
+(zero-page) write gives page 0 a frame
+(zero-page) page 0 holds the write
+(zero-page) page 1 still maps the zero frame
+(zero-page) end
+EOF
+pass;
@@ -31,11 +31,18 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/evict.h"
+#include "vm/ksm.h"
+#include "vm/reclaim.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -155,7 +162,9 @@ paging_init (uint64_t mem_end) {
 	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
 		uint64_t va = (uint64_t) ptov(pa);
 
-		perm = PTE_P | PTE_W;
+		/* Every address space maps the kernel the same way, so its
+		 * TLB entries can survive a switch between them. */
+		perm = PTE_P | PTE_W | PTE_G;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
@@ -165,6 +174,7 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_init_tlb ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -226,6 +236,28 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-evict")) {
+			if (value == NULL || !evict_select (value))
+				PANIC ("unknown eviction policy `%s' (use -h for help)", value);
+		}
+		else if (!strcmp (name, "-swap")) {
+			if (!swap_add (value))
+				PANIC ("bad swap disk `%s' (use -h for help)", value);
+		}
+		else if (!strcmp (name, "-swap-ra"))
+			swap_readahead = atoi (value);
+		else if (!strcmp (name, "-wm-low"))
+			reclaim_low_wm = atoi (value);
+		else if (!strcmp (name, "-wm-high"))
+			reclaim_high_wm = atoi (value);
+		else if (!strcmp (name, "-zswap"))
+			zswap_limit = atoi (value);
+		else if (!strcmp (name, "-ksm"))
+			ksm_scan_rate = atoi (value);
+		else if (!strcmp (name, "-hugepages"))
+			vm_huge_pages = true;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -272,6 +304,9 @@ run_actions (char **argv) {
 		{"rm", 2, fsutil_rm},
 		{"put", 2, fsutil_put},
 		{"get", 2, fsutil_get},
+#ifdef EFILESYS
+		{"fat-bench", 1, fsutil_fat_bench},
+#endif
 #endif
 		{NULL, 0, NULL},
 	};
@@ -316,6 +351,9 @@ usage (void) {
 			"  ls                 List files in the root directory.\n"
 			"  cat FILE           Print FILE to the console.\n"
 			"  rm FILE            Delete FILE.\n"
+#ifdef EFILESYS
+			"  fat-bench          Time cluster allocation over the whole disk.\n"
+#endif
 			"Use these actions indirectly via `pintos' -g and -p options:\n"
 			"  put FILE           Put FILE into file system from scratch disk.\n"
 			"  get FILE           Get FILE from file system into scratch disk.\n"
@@ -328,6 +366,17 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -evict=POLICY      Page replacement: fifo, clock, 2q or arc.\n"
+			"  -swap=C:D[:PRIO]   Swap to disk hdC:D, before disks of lower PRIO.\n"
+			"  -swap-ra=COUNT     Read up to COUNT neighbouring pages back from swap.\n"
+			"  -wm-low=COUNT      Start background reclaim below COUNT free frames.\n"
+			"  -wm-high=COUNT     Stop background reclaim at COUNT free frames.\n"
+			"  -zswap=PAGES       Keep up to PAGES of compressed swap in memory.\n"
+			"  -hugepages         Map large anonymous regions with 2 MiB pages.\n"
+			"  -ksm=PAGES         Merge identical anonymous pages, scanning PAGES\n"
+			"                     frames every 100 ms.\n"
 #endif
 			);
 	power_off ();
@@ -354,12 +403,19 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	inode_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
+	pml4_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
@@ -4,10 +4,92 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Number of huge pages split back into 4 kB pages. */
+static long long huge_split_cnt;
+
+/* Process-context IDs.  With CR4.PCIDE set, the TLB tags its entries
+ * with the PCID in the low bits of CR3, and loading CR3 with bit 63 set
+ * keeps them, so switching between address spaces need not flush the
+ * TLB.  Each pml4 gets its PCID by hashing its address.  A PCID is
+ * flushed when it is loaded for a different pml4 than last time, or
+ * after its pml4 changed while it was not loaded, so a pml4 never sees
+ * entries that are not its own.  PCID 0 is base_pml4's. */
+#define PCID_CNT 4096
+#define CR3_NOFLUSH (1ULL << 63)
+#define CR4_PGE (1 << 7)				/* Global pages. */
+#define CR4_PCIDE (1 << 17)				/* Process-context IDs. */
+#define CPUID_PCID (1 << 17)			/* CPUID.01H:ECX. */
+
+static bool pcid_enabled;
+static uint64_t *pcid_owner[PCID_CNT];	/* pml4 the PCID last tagged. */
+static bool pcid_stale[PCID_CNT];		/* Flush on its next load. */
+static long long switch_cnt;			/* # of CR3 loads. */
+static long long flush_cnt;				/* # of those that flushed. */
+
+/* Returns the PCID of PML4. */
+static unsigned
+pml4_pcid (uint64_t *pml4) {
+	if (pml4 == base_pml4)
+		return 0;
+	return 1 + (vtop (pml4) >> PGBITS) % (PCID_CNT - 1);
+}
+
+/* Returns whether PML4 is the page directory in use. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Makes the TLB forget VA in PML4, whose mapping just changed.  Called
+ * with interrupts off, together with the change, so that PML4 cannot
+ * be loaded between the two. */
+static void
+tlb_flush_page (uint64_t *pml4, const void *va) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (pml4_is_active (pml4))
+		invlpg ((uint64_t) va);
+	else if (pcid_enabled)
+		pcid_stale[pml4_pcid (pml4)] = true;
+}
+
+/* Like tlb_flush_page(), for all of PML4, including the cached upper
+ * levels of its page tables. */
+static void
+tlb_flush_all (uint64_t *pml4) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (pml4_is_active (pml4))
+		lcr3 (rcr3 ());
+	else if (pcid_enabled)
+		pcid_stale[pml4_pcid (pml4)] = true;
+}
+
+/* Replaces the huge page mapped by page directory entry PDE with a page
+ * table mapping the same frames as 4 kB pages, so that one of them can
+ * be changed on its own.  The accessed and dirty bits of the huge page
+ * are copied to every page.  Returns false if memory is short. */
+static bool
+pde_split (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t pa = PTE_ADDR (*pde) & ~(HPAGE_SIZE - 1);
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	huge_split_cnt++;
+	return true;
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -23,6 +105,10 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		/* Asking for the PTE of a page inside a huge page means it is
+		 * about to change on its own. */
+		if ((pdp[idx] & PTE_PS) && !pde_split (&pdp[idx]))
+			PANIC ("pgdir_walk: out of memory splitting a huge page");
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -88,6 +174,44 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the entry of TABLE for the next level down, allocating the
+ * table it points to if CREATE is true and there is none. */
+static uint64_t *
+table_walk (uint64_t *entry, bool create) {
+	if (!(*entry & PTE_P)) {
+		uint64_t *new_page;
+
+		if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (*entry));
+}
+
+/* Returns the page directory entry for VA in PML4, or a null pointer if
+ * there is no page directory for VA and CREATE is false.  Unlike
+ * pml4e_walk(), this never splits a huge page. */
+static uint64_t *
+pde_walk (uint64_t *pml4, const uint64_t va, bool create) {
+	uint64_t *pdpe, *pd;
+
+	if (pml4 == NULL || (pdpe = table_walk (&pml4[PML4 (va)], create)) == NULL
+			|| (pd = table_walk (&pdpe[PDPE (va)], create)) == NULL)
+		return NULL;
+	return &pd[PDX (va)];
+}
+
+/* Returns the page directory entry mapping VA in PML4 if it maps a
+ * huge page, otherwise a null pointer. */
+static uint64_t *
+huge_pde (uint64_t *pml4, const void *va) {
+	uint64_t *pde = pde_walk (pml4, (uint64_t) va, false);
+
+	if (pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+		return pde;
+	return NULL;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,7 +246,7 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && !(((uint64_t) pte) & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -157,11 +281,13 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 
 static void
 pt_destroy (uint64_t *pt) {
+#ifndef VM
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
 		if (((uint64_t) pte) & PTE_P)
 			palloc_free_page ((void *) PTE_ADDR (pte));
 	}
+#endif
 	palloc_free_page ((void *) pt);
 }
 
@@ -169,7 +295,8 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* The frames of a huge page belong to the VM system. */
+		if ((((uint64_t) pte) & PTE_P) && !(((uint64_t) pte) & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -185,7 +312,11 @@ pdpe_destroy (uint64_t *pdpe) {
 	palloc_free_page ((void *) pdpe);
 }
 
-/* Destroys pml4e, freeing all the pages it references. */
+/* Destroys pml4e, freeing all the pages it references.
+ * With VM, user frames belong to the frame table, which has freed them
+ * already, so only the page tables themselves are freed.  A dying
+ * process leaves its pages mapped until then, see
+ * supplemental_page_table_kill(). */
 void
 pml4_destroy (uint64_t *pml4) {
 	if (pml4 == NULL)
@@ -196,14 +327,63 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+
+	/* A new pml4 may get the same page, but not its TLB entries. */
+	if (pcid_owner[pml4_pcid (pml4)] == pml4)
+		pcid_owner[pml4_pcid (pml4)] = NULL;
 	palloc_free_page ((void *) pml4);
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  The TLB keeps what it knows of PD from the last time it
+ * was loaded, if PCIDs are in use and nothing has changed since. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	uint64_t cr3;
+	unsigned pcid;
+	enum intr_level old_level;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	cr3 = vtop (pml4);
+
+	old_level = intr_disable ();
+	switch_cnt++;
+	if (pcid_enabled) {
+		pcid = pml4_pcid (pml4);
+		if (pcid_owner[pcid] == pml4 && !pcid_stale[pcid])
+			cr3 |= CR3_NOFLUSH;
+		else
+			flush_cnt++;
+		pcid_owner[pcid] = pml4;
+		pcid_stale[pcid] = false;
+		cr3 |= pcid;
+	} else
+		flush_cnt++;
+	lcr3 (cr3);
+	intr_set_level (old_level);
+}
+
+/* Turns on global pages, so that the kernel's mappings stay in the TLB
+ * across CR3 loads, and PCIDs if the CPU has them.  Called once
+ * base_pml4 is loaded, with PCID 0 as PCIDE requires. */
+void
+pml4_init_tlb (void) {
+	ASSERT (pml4_is_active (base_pml4));
+
+	lcr4 (rcr4 () | CR4_PGE);
+	if (cpuid_ecx (1) & CPUID_PCID) {
+		lcr4 (rcr4 () | CR4_PCIDE);
+		pcid_owner[0] = base_pml4;
+		pcid_enabled = true;
+	}
+}
+
+/* Prints statistics about address space switches. */
+void
+pml4_print_stats (void) {
+	printf ("TLB: PCIDs %s, %lld address space switches, %lld flushed\n",
+			pcid_enabled ? "on" : "off", switch_cnt, flush_cnt);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,6 +394,11 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
+	uint64_t *pde = huge_pde (pml4, uaddr);
+	if (pde != NULL)
+		return ptov (PTE_ADDR (*pde) & ~(HPAGE_SIZE - 1))
+			+ ((uint64_t) uaddr & (HPAGE_SIZE - 1));
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
 	if (pte && (*pte & PTE_P))
@@ -243,6 +428,49 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Maps the huge page at user virtual address UPAGE in PML4 to the
+ * HPAGE_SIZE bytes of physical memory at kernel virtual address KPAGE,
+ * with a single page directory entry.  Both must be aligned to
+ * HPAGE_SIZE, and nothing in the range may be mapped yet.  An empty
+ * page table left over from earlier mappings is freed.  Returns false
+ * if memory is short or part of the range is mapped. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde;
+
+	ASSERT (((uint64_t) upage & (HPAGE_SIZE - 1)) == 0);
+	ASSERT ((vtop (kpage) & (HPAGE_SIZE - 1)) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pde_walk (pml4, (uint64_t) upage, true);
+	if (pde == NULL)
+		return false;
+	if (*pde & PTE_P) {
+		uint64_t *pt;
+
+		if (*pde & PTE_PS)
+			return false;
+		pt = ptov (PTE_ADDR (*pde));
+		for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+			if (pt[i] & PTE_P)
+				return false;
+		enum intr_level old_level = intr_disable ();
+		*pde = 0;
+		tlb_flush_all (pml4);
+		intr_set_level (old_level);
+		palloc_free_page (pt);
+	}
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
+/* Returns the number of huge pages split into 4 kB pages so far. */
+long long
+pml4_huge_splits (void) {
+	return huge_split_cnt;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -256,9 +484,10 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
+		enum intr_level old_level = intr_disable ();
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_flush_page (pml4, upage);
+		intr_set_level (old_level);
 	}
 }
 
@@ -268,6 +497,10 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
+	uint64_t *pde = huge_pde (pml4, vpage);
+	if (pde != NULL)
+		return (*pde & PTE_D) != 0;
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
@@ -278,13 +511,13 @@ void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	if (pte) {
+		enum intr_level old_level = intr_disable ();
 		if (dirty)
 			*pte |= PTE_D;
 		else
 			*pte &= ~(uint32_t) PTE_D;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_flush_page (pml4, vpage);
+		intr_set_level (old_level);
 	}
 }
 
@@ -294,6 +527,10 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
+	uint64_t *pde = huge_pde (pml4, vpage);
+	if (pde != NULL)
+		return (*pde & PTE_A) != 0;
+
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
@@ -302,14 +539,34 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
    VPAGE in PD. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	/* The accessed bit of a huge page covers all of its pages, so it
+	 * is changed in place rather than split off. */
+	uint64_t *pte = huge_pde (pml4, vpage);
+	if (pte == NULL)
+		pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	if (pte) {
+		enum intr_level old_level = intr_disable ();
 		if (accessed)
 			*pte |= PTE_A;
 		else
 			*pte &= ~(uint32_t) PTE_A;
+		tlb_flush_page (pml4, vpage);
+		intr_set_level (old_level);
+	}
+}
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+/* Sets the writable bit to WRITABLE in the PTE for virtual page VPAGE
+ * in PML4, leaving the other bits alone. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte) {
+		enum intr_level old_level = intr_disable ();
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+		tlb_flush_page (pml4, vpage);
+		intr_set_level (old_level);
 	}
 }
@@ -8,8 +8,11 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,18 +27,33 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   The idle thread zeroes free pages ahead of time, so that PAL_ZERO
+   allocations need not.  A pre-zeroed page is set aside: it is
+   marked used in used_map and set in zeroed_map, and is handed out
+   to plain allocations only when no other page will do. */
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
+	struct bitmap *zeroed_map;      /* Bitmap of pre-zeroed pages. */
+	size_t zeroed_cnt;              /* Number of pre-zeroed pages. */
+	size_t free_cnt;                /* Free pages, pre-zeroed included. */
 	uint8_t *base;                  /* Base of pool. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* At most this fraction of a pool is kept pre-zeroed. */
+#define ZEROED_SHARE 4
+
+static long long zero_hit_cnt;      /* # of PAL_ZERO pages pre-zeroed. */
+static long long zero_miss_cnt;     /* # of PAL_ZERO pages zeroed inline. */
+static long long idle_zero_cnt;     /* # of pages zeroed while idle. */
+
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 static void
@@ -224,11 +242,13 @@ split:
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool->free_cnt += page_cnt;
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				pool->free_cnt += page_cnt;
 			}
 		}
 	}
@@ -253,6 +273,55 @@ palloc_init (void) {
 	return ext_mem.end;
 }
 
+/* Adds DELTA to POOL's count of free pages.  Pages are freed without
+   the pool lock, so the count is kept with interrupts off instead. */
+static void
+adjust_free_cnt (struct pool *pool, long delta) {
+	enum intr_level old_level = intr_disable ();
+
+	pool->free_cnt += delta;
+	intr_set_level (old_level);
+}
+
+/* Takes pre-zeroed page PAGE_IDX of POOL, which stays marked used. */
+static void
+take_zeroed (struct pool *pool, size_t page_idx) {
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	bitmap_reset (pool->zeroed_map, page_idx);
+	pool->zeroed_cnt--;
+}
+
+/* Gives all of POOL's pre-zeroed pages back to the free pages, for an
+   allocation that could not be met without them. */
+static void
+drain_zeroed (struct pool *pool) {
+	size_t page_idx = 0;
+
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	while ((page_idx = bitmap_scan (pool->zeroed_map, page_idx, 1, true))
+			!= BITMAP_ERROR) {
+		take_zeroed (pool, page_idx);
+		bitmap_reset (pool->used_map, page_idx);
+	}
+}
+
+/* Fills with zeros the PAGE_CNT pages at PAGES that were not
+   pre-zeroed, according to ZEROED, an array of PAGE_CNT flags. */
+static void
+zero_pages (uint8_t *pages, size_t page_cnt, const bool zeroed[]) {
+	size_t i;
+
+	for (i = 0; i < page_cnt; i++)
+		if (zeroed[i])
+			zero_hit_cnt++;
+		else {
+			memset (pages + PGSIZE * i, 0, PGSIZE);
+			zero_miss_cnt++;
+		}
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -262,11 +331,34 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	bool zeroed = false;
+	size_t page_idx = BITMAP_ERROR;
+	void *pages;
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	/* A single page comes from the pre-zeroed ones if it has to be
+	   zeroed, or if there is nothing else. */
+	if (page_cnt == 1 && (flags & PAL_ZERO) && pool->zeroed_cnt > 0)
+		page_idx = bitmap_scan (pool->zeroed_map, 0, 1, true);
+	if (page_idx == BITMAP_ERROR)
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	else
+		zeroed = true;
+	if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) {
+		if (page_cnt == 1) {
+			page_idx = bitmap_scan (pool->zeroed_map, 0, 1, true);
+			zeroed = true;
+		} else {
+			drain_zeroed (pool);
+			page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt,
+					false);
+		}
+	}
+	if (zeroed)
+		take_zeroed (pool, page_idx);
+	if (page_idx != BITMAP_ERROR)
+		adjust_free_cnt (pool, -(long) page_cnt);
 	lock_release (&pool->lock);
-	void *pages;
 
 	if (page_idx != BITMAP_ERROR)
 		pages = pool->base + PGSIZE * page_idx;
@@ -274,8 +366,14 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 		pages = NULL;
 
 	if (pages) {
-		if (flags & PAL_ZERO)
-			memset (pages, 0, PGSIZE * page_cnt);
+		if (flags & PAL_ZERO) {
+			if (zeroed)
+				zero_hit_cnt++;
+			else {
+				memset (pages, 0, PGSIZE * page_cnt);
+				zero_miss_cnt += page_cnt;
+			}
+		}
 	} else {
 		if (flags & PAL_ASSERT)
 			PANIC ("palloc_get: out of pages");
@@ -284,6 +382,66 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Like palloc_get_multiple(), but the first page returned is a
+   multiple of ALIGN pages into physical memory.  Used for huge
+   pages, which must be contiguous and naturally aligned. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t page_idx = (align - pg_no (pool->base) % align) % align;
+	bool *zeroed = NULL;
+	void *pages = NULL;
+	size_t i;
+
+	ASSERT (align > 0);
+
+	if (flags & PAL_ZERO) {
+		zeroed = malloc (page_cnt * sizeof *zeroed);
+		if (zeroed == NULL)
+			goto done;
+	}
+
+	/* Pre-zeroed pages count as free here: a large run is rare enough
+	   that setting them aside would mostly get in the way. */
+	lock_acquire (&pool->lock);
+	for (; page_idx + page_cnt <= pool_cnt; page_idx += align) {
+		for (i = 0; i < page_cnt; i++)
+			if (bitmap_test (pool->used_map, page_idx + i)
+					&& !bitmap_test (pool->zeroed_map, page_idx + i))
+				break;
+		if (i < page_cnt)
+			continue;
+
+		for (i = 0; i < page_cnt; i++) {
+			bool was_zeroed = bitmap_test (pool->zeroed_map, page_idx + i);
+
+			if (was_zeroed)
+				take_zeroed (pool, page_idx + i);
+			else
+				bitmap_mark (pool->used_map, page_idx + i);
+			if (zeroed != NULL)
+				zeroed[i] = was_zeroed;
+		}
+		adjust_free_cnt (pool, -(long) page_cnt);
+		pages = pool->base + PGSIZE * page_idx;
+		break;
+	}
+	lock_release (&pool->lock);
+
+	if (pages != NULL && zeroed != NULL)
+		zero_pages (pages, page_cnt, zeroed);
+	free (zeroed);
+
+done:
+	if (pages == NULL) {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -320,6 +478,7 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	adjust_free_cnt (pool, page_cnt);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +487,69 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool.  Cheap enough
+   to call on every allocation. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.free_cnt;
+}
+
+/* Zeroes one free page of POOL and sets it aside as pre-zeroed.
+   Returns false if POOL is busy, has enough pre-zeroed pages or has
+   no other free page. */
+static bool
+zero_free_page (struct pool *pool) {
+	size_t page_idx;
+
+	if (pool->zeroed_cnt >= bitmap_size (pool->used_map) / ZEROED_SHARE
+			|| !lock_try_acquire (&pool->lock))
+		return false;
+	page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+	lock_release (&pool->lock);
+	if (page_idx == BITMAP_ERROR)
+		return false;
+
+	memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+	/* The idle thread must not block, so it gets out of the way of
+	   whoever holds the lock instead. */
+	while (!lock_try_acquire (&pool->lock))
+		thread_yield ();
+	bitmap_mark (pool->zeroed_map, page_idx);
+	pool->zeroed_cnt++;
+	lock_release (&pool->lock);
+	idle_zero_cnt++;
+	return true;
+}
+
+/* Zeroes a free page ahead of a PAL_ZERO allocation.  Called by the
+   idle thread until it returns false, when there is nothing left to
+   do or a pool is busy. */
+bool
+palloc_zero_idle (void) {
+	return zero_free_page (&user_pool) || zero_free_page (&kernel_pool);
+}
+
+/* Prints statistics about pre-zeroed pages. */
+void
+palloc_print_stats (void) {
+	long long zero_cnt = zero_hit_cnt + zero_miss_cnt;
+
+	printf ("Zeroing: %lld of %lld zeroed pages pre-zeroed (%lld%%), "
+			"%lld pages zeroed while idle, %zu kernel and %zu user pages "
+			"ready\n", zero_hit_cnt, zero_cnt,
+			zero_cnt ? zero_hit_cnt * 100 / zero_cnt : 0, idle_zero_cnt,
+			kernel_pool.zeroed_cnt, user_pool.zeroed_cnt);
+}
+
+/* Returns the first page of the user pool and stores the number of
+   pages in it in *PAGE_CNT. */
+void *
+palloc_user_pool (size_t *page_cnt) {
+	*page_cnt = bitmap_size (user_pool.used_map);
+	return user_pool.base;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -339,12 +561,17 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->zeroed_map = bitmap_create_in_buf (pgcnt, *bm_base + bm_pages,
+			bm_pages);
+	p->zeroed_cnt = 0;
+	p->free_cnt = 0;
 	p->base = (void *) start;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	bitmap_set_all(p->zeroed_map, false);
 
-	*bm_base += bm_pages;
+	*bm_base += 2 * bm_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
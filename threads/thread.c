@@ -51,6 +51,8 @@ static struct list destruction_req;
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long zero_ticks;    /* # of idle ticks spent zeroing pages. */
+static bool idle_zeroing;       /* Idle thread is zeroing free pages. */
 
 /* Scheduling. */
 #define TIMER_FREQ 100
@@ -217,8 +219,11 @@ thread_tick (void) {
 	struct thread *t = thread_current ();
 
 	/* Update statistics. */
-	if (t == idle_thread)
+	if (t == idle_thread) {
 		idle_ticks++;
+		if (idle_zeroing)
+			zero_ticks++;
+	}
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
 		user_ticks++;
@@ -236,6 +241,7 @@ void
 thread_print_stats (void) {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	printf ("Idle: %lld ticks spent zeroing free pages\n", zero_ticks);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -484,6 +490,13 @@ idle (void *idle_started_ UNUSED) {
 	sema_up (idle_started);
 
 	for (;;) {
+		/* Zero free pages while nobody else wants the CPU, so that
+		   PAL_ZERO allocations find them ready. */
+		idle_zeroing = true;
+		while (list_empty (&ready_list) && palloc_zero_idle ())
+			continue;
+		idle_zeroing = false;
+
 		/* Let someone else run. */
 		intr_disable ();
 		thread_block ();
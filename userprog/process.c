@@ -20,6 +20,7 @@
 #include "intrinsic.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/vma.h"
 #endif
 
 static void process_cleanup (void);
@@ -694,13 +695,18 @@ bool
 lazy_load_segment (struct page *page, void *aux) {
 	struct file_info	*file_info = (struct file_info *)aux;
 	uint8_t				*kpage = page->frame->kva;
+	off_t				read_bytes;
 
 	// print_spt();
-	file_seek(file_info->file, file_info->ofs);
-	if (file_read (file_info->file, kpage, file_info->page_read_bytes) != (int) file_info->page_read_bytes) {
-		palloc_free_page (page->frame->kva);
+	/* PAGE is busy and its frame is not yet on the eviction queues, so
+	 * both stay put while the file is read without vm_lock. */
+	vm_io_begin ();
+	read_bytes = file_read_at (file_info->file, kpage, file_info->page_read_bytes, file_info->ofs);
+	vm_io_end ();
+	/* The frame belongs to the frame table; whoever claimed it frees
+	 * it. */
+	if (read_bytes != (off_t) file_info->page_read_bytes)
 		return false;
-	}
 	memset(kpage + file_info->page_read_bytes, 0, file_info->page_zero_bytes);
  
 	return true;
@@ -727,37 +733,11 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		struct file_info *file_info = (struct file_info *)calloc(sizeof(struct file_info), 1);
-		if (file_info == NULL)
-			return false;
-		file_info->read_bytes = read_bytes;
-		file_info->page_read_bytes = page_read_bytes;
-		file_info->page_zero_bytes = page_zero_bytes;
-		file_info->ofs = ofs;
-		file_info->file = file;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = file_info;
-		
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage, writable, lazy_load_segment, aux)) {
-			// free(file_info);
-			return false;
-		}
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		ofs += page_read_bytes;
-	}
-	return true;
+	/* One region describes the whole segment.  Its pages get their
+	 * struct page when they are first touched. */
+	return vma_add (&thread_current ()->spt, upage,
+			(read_bytes + zero_bytes) / PGSIZE, VM_ANON, writable,
+			lazy_load_segment, file, ofs, read_bytes) != NULL;
 }
 
 bool
@@ -766,53 +746,20 @@ mmap_load_segment (struct file *file, off_t ofs, uint8_t *upage,
 
 	size_t read_bytes = (size_t)file_length(file);
 	// printf("read bytes : %d\n",read_bytes);
-	file = file_reopen(file);
-	while (read_bytes > 0) {
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		struct file_info *file_info = (struct file_info *)malloc(sizeof(struct file_info));
-		if (file_info == NULL)
-			return false;
-
-		file_info->read_bytes = read_bytes;
-		file_info->page_read_bytes = page_read_bytes;
-		file_info->page_zero_bytes = page_zero_bytes;
-		file_info->ofs = ofs;
-		file_info->file = file;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = file_info;
-		
-		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable, lazy_load_segment, aux))
-			return false;
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		upage += PGSIZE;
-		ofs += page_read_bytes;
+	struct file *mfile = file_reopen(file);
+	if (mfile == NULL)
+		return false;
+	if (vma_add (&thread_current ()->spt, upage,
+				DIV_ROUND_UP (read_bytes, PGSIZE), VM_FILE, writable,
+				lazy_load_segment, mfile, ofs, read_bytes) == NULL) {
+		file_close (mfile);
+		return false;
 	}
 	return true;
 }
 
 void do_munmap(void *addr) {
-	// print_spt();
-	struct page *page = spt_find_page(&thread_current()->spt, addr);
-	if (page == NULL)
-		return ;
-	
-	if (page_get_type(page) != VM_FILE)
-		return ;
-
-	struct file_info *file_info = (struct file_info *)page->file.aux;
-	size_t read_bytes = file_info->read_bytes;
-
-	while (page != NULL && read_bytes != 0) {
-		read_bytes = read_bytes < PGSIZE ? 0 : read_bytes - PGSIZE;
-		hash_delete(&thread_current()->spt.h, &page->hash_elem);
-		vm_dealloc_page (page);
-		addr += PGSIZE;
-		page = spt_find_page(&thread_current()->spt, addr);
-	}
+	spt_unmap (&thread_current ()->spt, addr);
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -821,7 +768,8 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	if (vm_alloc_page (VM_ANON | VM_MARKER_0, stack_bottom, 1)) {
+	if (vma_add (&thread_current ()->spt, stack_bottom, 1,
+				VM_ANON | VM_MARKER_0, true, NULL, NULL, 0, 0) != NULL) {
 		success = vm_claim_page(stack_bottom);
 
 		if (success)
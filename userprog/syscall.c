@@ -24,6 +24,8 @@ void remove_file_from_fdt(int fd);
 
 void check_buffer(const uint64_t *useradd);
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length);
 
 /* System call.
  *
@@ -106,6 +108,12 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	case SYS_MUNMAP:
 		munmap((void *)f->R.rdi);
 		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise((void *)f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_MSYNC:
+		f->R.rax = msync((void *)f->R.rdi, f->R.rsi);
+		break;
 	default:
 		exit(-1);
 		break;
@@ -298,6 +306,9 @@ void close (int fd) {
 
 
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset) {
+	bool populate = (writable & MAP_POPULATE) != 0;
+
+	writable &= ~MAP_POPULATE;
 	// printf("addr %p, length %d, fd %d, offset : %d", addr, length, fd, offset);
 	if (addr == NULL || is_kernel_vaddr(addr) || is_kernel_vaddr(addr - length) || addr != pg_round_down(addr))
 		return NULL;
@@ -322,6 +333,8 @@ void *mmap(void *addr, size_t length, int writable, int fd, off_t offset) {
 	
 	if (!mmap_load_segment(file, offset, addr, length, writable))
 		return NULL;
+	if (populate)
+		spt_populate(&thread_current()->spt, addr, length);
 	return addr;
 }
 
@@ -330,6 +343,14 @@ void munmap (void *addr) {
 	do_munmap(addr);
 }
 
+int madvise (void *addr, size_t length, int advice) {
+	return spt_advise(&thread_current()->spt, addr, length, advice) ? 0 : -1;
+}
+
+int msync (void *addr, size_t length) {
+	return spt_msync(&thread_current()->spt, addr, length) ? 0 : -1;
+}
+
 //file descriptor 서브 함수들 
 
 /* fdt안에 파일 넣기*/
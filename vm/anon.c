@@ -1,22 +1,39 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
 #include "vm/vm.h"
+#include "vm/evict.h"
+#include "vm/text.h"
+#include "vm/swap.h"
+#include "vm/vma.h"
+#include "vm/zswap.h"
+#include "userprog/process.h"
+#include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "threads/pte.h"
 #include "threads/mmu.h"
 
-
-#include "lib/kernel/bitmap.h"
-
 /* DO NOT MODIFY BELOW LINE */
-static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
 
-static struct bitmap *swap_bitmap;
+/* The page held in each swap slot, protected by vm_lock.  Slots are
+ * allocated in vm/swap.c.  A slot is taken before its page is written
+ * and given back only after its page has been read. */
+static struct page **slot_pages;
 
-static struct lock swap_lock;
+/* Neighbouring pages of the same process read back along with a
+ * faulting page, at most SWAP_CLUSTER - 1.  Set with -swap-ra. */
+size_t swap_readahead;
+
+static long long page_out_cnt;		/* # of pages written to swap. */
+static long long cluster_cnt;		/* # of transfers they took. */
+static long long page_in_cnt;		/* # of pages read from swap. */
+static long long readahead_cnt;		/* # of those that were not faulted. */
+static long long exec_drop_cnt;		/* # of ELF pages dropped instead. */
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
@@ -26,20 +43,15 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
-#define PAGE_SHIFT 12
-#define PAGE_SIZE (1 << PAGE_SHIFT)
-#define ONE_MB (1 << 20) // 1MB
-#define CHUNK_SIZE (20*ONE_MB)
-#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
-
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
-	swap_disk = disk_get(1, 1);
-	int swap_size = disk_size(swap_disk);
-	swap_bitmap = bitmap_create(swap_size / 8);
-	lock_init(&swap_lock);
+	swap_init ();
+	slot_pages = calloc (swap_slot_cnt () + 1, sizeof *slot_pages);
+	if (slot_pages == NULL)
+		PANIC ("vm_anon_init : out of memory");
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
@@ -51,27 +63,155 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	struct anon_page *anon_page = &page->anon;
 
 	anon_page->swap_slot = -1;
+	anon_page->zswap = NULL;
+	/* A page of an ELF segment is about to be read from the file, unless
+	 * it is mapped to the zero frame, which holds the same. */
+	anon_page->clean = anon_page->init == lazy_load_segment
+		&& anon_page->aux != NULL;
 
 	return true;
 }
 
+/* Gives back SLOT, which belonged to a page of SPT while SPT is torn
+ * down.  Slots of a cluster were taken together and are usually freed
+ * one after another, so they are collected into a run and go back to
+ * the bitmap together. */
+static void
+swap_free_dead (struct supplemental_page_table *spt, size_t slot) {
+	if (spt->dead_slot_cnt > 0) {
+		if (slot == spt->dead_slot + spt->dead_slot_cnt) {
+			spt->dead_slot_cnt++;
+			return;
+		}
+		if (slot + 1 == spt->dead_slot) {
+			spt->dead_slot--;
+			spt->dead_slot_cnt++;
+			return;
+		}
+		anon_free_dead_slots (spt);
+	}
+	spt->dead_slot = slot;
+	spt->dead_slot_cnt = 1;
+}
+
+/* Gives back the run of slots collected by swap_free_dead(). */
+void
+anon_free_dead_slots (struct supplemental_page_table *spt) {
+	if (spt->dead_slot_cnt > 0)
+		swap_free (spt->dead_slot, spt->dead_slot_cnt);
+	spt->dead_slot_cnt = 0;
+}
+
+/* Writes the CNT PAGES to the swap slots starting at SLOT, which the
+ * caller has already taken, and unmaps them. */
+static void
+swap_out_slots (size_t slot, struct page *pages[], size_t cnt) {
+	void *kvas[SWAP_CLUSTER];
+	size_t i;
+
+	/* Unmap first, so that the owner cannot change a page behind the
+	 * write.  It faults instead, and waits for the page to stop being
+	 * busy. */
+	for (i = 0; i < cnt; i++) {
+		kvas[i] = pages[i]->frame->kva;
+		pml4_clear_page (pages[i]->owner->pml4, pages[i]->va);
+	}
+	swap_transfer (slot, kvas, cnt, true);
+
+	for (i = 0; i < cnt; i++) {
+		pages[i]->anon.swap_slot = slot + i;
+		slot_pages[slot + i] = pages[i];
+	}
+	page_out_cnt += cnt;
+	cluster_cnt++;
+}
+
+/* Unmaps PAGE, a page of program text or ELF data that was never
+ * written, without writing it anywhere.  It comes back from the
+ * executable. */
+static void
+drop_exec (struct page *page) {
+	pml4_clear_page (page->owner->pml4, page->va);
+	exec_drop_cnt++;
+}
+
+/* Unmaps PAGE and tries to keep it compressed in memory rather than
+ * on disk.  Returns false if it has to go to disk after all. */
+static bool
+zswap_out (struct page *page) {
+	pml4_clear_page (page->owner->pml4, page->va);
+	page->anon.zswap = zswap_store (page->frame->kva);
+	return page->anon.zswap != NULL;
+}
+
 /* Swap in the page by read contents from the swap disk. */
 /* 스왑 디스크 데이터 내용을 읽어서 익명 페이지를(디스크에서 메모리로)  swap in합니다. 
 	스왑 아웃 될 때 페이지 구조체는 스왑 디스크에 저장되어 있어야 합니다.
 	스왑 테이블을 업데이트해야 합니다(스왑 테이블 관리 참조). */
 static bool
 anon_swap_in (struct page *page, void *kva) {
-	struct anon_page *anon_page = &page->anon;
-	void *kva_ = pg_round_down (page->frame->kva);
+	struct page *pages[SWAP_CLUSTER];
+	void *kvas[SWAP_CLUSTER];
+	size_t slot = page->anon.swap_slot;
+	size_t readahead = swap_readahead;
+	size_t cnt, i;
 
-	lock_acquire(&swap_lock);
-	for (int i = 0; i < 8; i++)
-		disk_read (swap_disk, anon_page->swap_slot * 8 + i, kva_ + (DISK_SECTOR_SIZE * i));
+	if (page->anon.zswap != NULL) {
+		zswap_load (page->anon.zswap, kva);
+		page->anon.zswap = NULL;
+		return true;
+	}
 
-	bitmap_set (swap_bitmap, anon_page->swap_slot, 0);
-	lock_release(&swap_lock);
+	if (page->anon.swap_slot == (disk_sector_t) -1) {
+		/* Program text or clean data that was dropped: read it from the
+		 * executable.  Otherwise the page was never written. */
+		if (exec_page_clean (page))
+			return lazy_load_segment (page, page->anon.aux);
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
 
-	anon_page->swap_slot = -1;
+	pages[0] = page;
+	kvas[0] = kva;
+	cnt = 1;
+	if (vma_advice (page) == MADV_RANDOM)
+		readahead = 0;
+	else if (vma_advice (page) == MADV_SEQUENTIAL)
+		readahead = SWAP_CLUSTER - 1;
+
+	/* Pages evicted together sit in consecutive slots.  Bring back the
+	 * ones that follow PAGE in the same process while there are free
+	 * frames for them; nothing is evicted to make room.  Each is busy
+	 * until its contents are in. */
+	while (cnt <= readahead && cnt < SWAP_CLUSTER
+			&& slot + cnt < swap_dev_end (slot)) {
+		struct page *next = slot_pages[slot + cnt];
+		struct frame *frame;
+
+		if (next == NULL || next->owner != page->owner || next->busy)
+			break;
+		frame = vm_claim_spare_frame (next);
+		if (frame == NULL)
+			break;
+		vm_page_set_busy (next, true);
+		pages[cnt] = next;
+		kvas[cnt++] = frame->kva;
+	}
+
+	swap_transfer (slot, kvas, cnt, false);
+	for (i = 0; i < cnt; i++) {
+		slot_pages[slot + i] = NULL;
+		pages[i]->anon.swap_slot = -1;
+	}
+	swap_free (slot, cnt);
+	page_in_cnt += cnt;
+	readahead_cnt += cnt - 1;
+
+	/* The faulting page is installed by our caller. */
+	for (i = 1; i < cnt; i++) {
+		vm_install_spare_frame (pages[i]);
+		vm_page_set_busy (pages[i], false);
+	}
 	return true;
 }
 
@@ -83,24 +223,65 @@ anon_swap_in (struct page *page, void *kva) {
 	디스크에 사용 가능한 슬롯이 더 이상 없으면 커널 패닉이 발생할 수 있습니다. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
-	void	*kva_ = pg_round_down (page->frame->kva);
-
-	lock_acquire(&swap_lock);
-	disk_sector_t swap_slot = bitmap_scan_and_flip(swap_bitmap, 0, 1, false);
-	if (swap_slot == BITMAP_ERROR)
-		PANIC ("Kernel Panic");
+	size_t slot;
 
-	for (int i = 0; i < 8; i++)
-		disk_write (swap_disk, (swap_slot * 8) + i, kva_ + (DISK_SECTOR_SIZE * i));
+	if (exec_page_clean (page)) {
+		drop_exec (page);
+		return true;
+	}
+	if (zswap_out (page))
+		return true;
 
-	anon_page->swap_slot = swap_slot;
-	pml4_clear_page(thread_current()->pml4, pg_round_down (page->va));
-	lock_release(&swap_lock);
+	slot = swap_alloc (1);
+	if (slot == SWAP_ERROR)
+		PANIC ("anon_swap_out : swap disk is full");
+	swap_out_slots (slot, &page, 1);
 
 	return true;
 }
 
+/* Swaps out the CNT anonymous pages in PAGES, at most SWAP_CLUSTER.
+ * Pages that compress well stay in memory; the rest go to consecutive
+ * slots with a single transfer.  Falls back to one transfer per page
+ * if swap has no free run that long.  The pages keep their frames; the
+ * caller unlinks them. */
+void
+anon_swap_out_cluster (struct page *pages[], size_t cnt) {
+	struct page *dirty[SWAP_CLUSTER];
+	size_t slot, i;
+
+	ASSERT (cnt <= SWAP_CLUSTER);
+
+	for (i = 0, slot = 0; i < cnt; i++)
+		if (exec_page_clean (pages[i]))
+			drop_exec (pages[i]);
+		else if (!zswap_out (pages[i]))
+			dirty[slot++] = pages[i];
+	pages = dirty;
+	cnt = slot;
+	if (cnt == 0)
+		return;
+
+	slot = swap_alloc (cnt);
+	if (slot != SWAP_ERROR) {
+		swap_out_slots (slot, pages, cnt);
+		return;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		slot = swap_alloc (1);
+		if (slot == SWAP_ERROR)
+			PANIC ("anon_swap_out : swap disk is full");
+		swap_out_slots (slot, &pages[i], 1);
+	}
+}
+
+/* Returns whether swap has at least CNT free slots. */
+bool
+anon_swap_has_room (size_t cnt) {
+	return swap_free_cnt () >= cnt;
+}
+
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
@@ -108,11 +289,31 @@ anon_destroy (struct page *page) {
 
 	if (anon_page->aux)
 		free(anon_page->aux);
+	if (anon_page->zswap != NULL) {
+		zswap_free (anon_page->zswap);
+		anon_page->zswap = NULL;
+	}
 
-	if (page->frame) {
-		list_remove(&page->frame->f_elem);
-		page->frame->page = NULL;
-		page->frame = NULL;
-		free (page->frame);
+	/* Read-ahead must not find PAGE once it is gone. */
+	if (anon_page->swap_slot != (disk_sector_t) -1) {
+		slot_pages[anon_page->swap_slot] = NULL;
+		if (page->owner->spt.dying)
+			swap_free_dead (&page->owner->spt, anon_page->swap_slot);
+		else
+			swap_free (anon_page->swap_slot, 1);
+		anon_page->swap_slot = -1;
 	}
+
+	vm_free_frame (page);
+}
+
+/* Print statistics about swap traffic. */
+void
+vm_anon_print_stats (void) {
+	printf ("Swap: %lld pages out in %lld transfers, %lld pages in "
+			"(%lld read ahead), %lld executable pages dropped\n",
+			page_out_cnt, cluster_cnt, page_in_cnt, readahead_cnt,
+			exec_drop_cnt);
+	zswap_print_stats (page_in_cnt);
+	swap_print_stats ();
 }
@@ -0,0 +1,408 @@
+/* evict.c: Page-replacement policies behind vm_get_victim.
+ *
+ * Every resident user frame sits on one of two queues, linked through
+ * frame->f_elem, and frame->queue records which one.  What the queues
+ * mean depends on the policy:
+ *
+ *   fifo   Q1 is the load order.  Accessed bits are ignored.
+ *   clock  Q1 is the clock.  A frame whose accessed bit is set gets a
+ *          second chance: the bit is cleared and the frame rotates to
+ *          the tail.
+ *   2q     Q1 is A1in (pages touched once), Q2 is Am (the hot set,
+ *          kept in approximate LRU order by second chance).  Pages
+ *          evicted from A1in are remembered on the A1out ghost list; a
+ *          page faulted back while still on A1out goes straight to Am.
+ *   arc    Q1 is T1 (recency), Q2 is T2 (frequency), run as two clocks
+ *          as in CAR, since we only learn about hits through accessed
+ *          bits.  Evicted pages are remembered on ghost lists B1/B2,
+ *          and a fault on a ghost moves the target size of T1 towards
+ *          whichever list would have kept the page resident.
+ *
+ * Ghosts identify a page by its owner thread and user virtual address.
+ * They carry no data, so a stale ghost costs at most one misplaced
+ * page. */
+
+#include "vm/evict.h"
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+#include "lib/kernel/hash.h"
+
+/* Values of frame->queue. */
+enum {
+	Q_NONE,                     /* Not tracked (being loaded or evicted). */
+	Q_FIRST,                    /* FIFO/clock list, 2Q A1in, ARC T1. */
+	Q_SECOND,                   /* 2Q Am, ARC T2. */
+	Q_CNT
+};
+
+struct evict_policy {
+	const char *name;
+	void (*install) (struct frame *);
+	struct frame *(*victim) (void);
+};
+
+/* A page that was recently evicted. */
+struct ghost {
+	struct hash_elem h_elem;    /* Element in ghost_table. */
+	struct list_elem l_elem;    /* Element in ghosts[queue]. */
+	struct thread *owner;
+	void *va;
+	int queue;                  /* Q_FIRST: A1out or B1, Q_SECOND: B2. */
+};
+
+static struct list queues[Q_CNT];
+static size_t queue_len[Q_CNT];
+static struct list ghosts[Q_CNT];
+static size_t ghost_len[Q_CNT];
+static struct hash ghost_table;
+
+/* Number of resident frames, and the most we have seen at once, which
+ * is how big the user pool turned out to be. */
+static size_t resident;
+static size_t capacity;
+
+/* ARC: target size of T1. */
+static size_t arc_p;
+
+static long long ghost_hit_cnt;
+
+/* Queue helpers. */
+
+static void
+queue_push (struct frame *frame, int q) {
+	frame->queue = q;
+	list_push_back (&queues[q], &frame->f_elem);
+	queue_len[q]++;
+}
+
+static void
+queue_del (struct frame *frame) {
+	ASSERT (frame->queue != Q_NONE);
+	list_remove (&frame->f_elem);
+	queue_len[frame->queue]--;
+	frame->queue = Q_NONE;
+}
+
+static struct frame *
+queue_front (int q) {
+	return list_entry (list_front (&queues[q]), struct frame, f_elem);
+}
+
+/* Returns whether any page mapping FRAME was accessed since we last
+ * looked, and clears the accessed bits for next time. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = frame->accessed;
+	struct list_elem *e;
+
+	frame->accessed = false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4 != NULL && pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Second chance over queue Q: returns the first frame from the head
+ * whose accessed bit is clear, rotating referenced ones to the tail. */
+static struct frame *
+second_chance (int q) {
+	while (queue_len[q] > 0) {
+		struct frame *frame = queue_front (q);
+
+		queue_del (frame);
+		if (!frame_test_and_clear_accessed (frame))
+			return frame;
+		queue_push (frame, q);
+	}
+	return NULL;
+}
+
+/* Ghost helpers. */
+
+static uint64_t
+ghost_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct ghost *g = hash_entry (e, struct ghost, h_elem);
+	return hash_bytes (&g->owner, sizeof g->owner)
+		^ hash_bytes (&g->va, sizeof g->va);
+}
+
+static bool
+ghost_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct ghost *a = hash_entry (a_, struct ghost, h_elem);
+	const struct ghost *b = hash_entry (b_, struct ghost, h_elem);
+	if (a->owner != b->owner)
+		return a->owner < b->owner;
+	return a->va < b->va;
+}
+
+static struct ghost *
+ghost_find (struct frame *frame) {
+	struct ghost key;
+	struct hash_elem *e;
+
+	key.owner = frame->page->owner;
+	key.va = frame->page->va;
+	e = hash_find (&ghost_table, &key.h_elem);
+	return e != NULL ? hash_entry (e, struct ghost, h_elem) : NULL;
+}
+
+static void
+ghost_del (struct ghost *g) {
+	hash_delete (&ghost_table, &g->h_elem);
+	list_remove (&g->l_elem);
+	ghost_len[g->queue]--;
+	free (g);
+}
+
+/* Forgets the oldest ghost on list Q. */
+static void
+ghost_drop_oldest (int q) {
+	if (ghost_len[q] > 0)
+		ghost_del (list_entry (list_front (&ghosts[q]), struct ghost, l_elem));
+}
+
+/* Remembers the page in FRAME, which is being evicted, on ghost list Q
+ * holding at most LIMIT entries. */
+static void
+ghost_add (struct frame *frame, int q, size_t limit) {
+	struct ghost *g;
+
+	if (limit == 0)
+		return;
+	while (ghost_len[q] >= limit)
+		ghost_drop_oldest (q);
+
+	g = malloc (sizeof *g);
+	if (g == NULL)
+		return;
+	g->owner = frame->page->owner;
+	g->va = frame->page->va;
+	g->queue = q;
+	if (hash_insert (&ghost_table, &g->h_elem) != NULL) {
+		free (g);
+		return;
+	}
+	list_push_back (&ghosts[q], &g->l_elem);
+	ghost_len[q]++;
+}
+
+/* FIFO. */
+
+static void
+fifo_install (struct frame *frame) {
+	queue_push (frame, Q_FIRST);
+}
+
+static struct frame *
+fifo_victim (void) {
+	struct frame *frame;
+
+	if (queue_len[Q_FIRST] == 0)
+		return NULL;
+	frame = queue_front (Q_FIRST);
+	queue_del (frame);
+	return frame;
+}
+
+/* Clock. */
+
+static struct frame *
+clock_victim (void) {
+	return second_chance (Q_FIRST);
+}
+
+/* 2Q. */
+
+static void
+twoq_install (struct frame *frame) {
+	struct ghost *g = ghost_find (frame);
+
+	if (g != NULL) {
+		ghost_hit_cnt++;
+		ghost_del (g);
+		queue_push (frame, Q_SECOND);
+	} else
+		queue_push (frame, Q_FIRST);
+}
+
+static struct frame *
+twoq_victim (void) {
+	size_t kin = capacity / 4 > 0 ? capacity / 4 : 1;
+	struct frame *frame;
+
+	if (queue_len[Q_FIRST] > kin || queue_len[Q_SECOND] == 0) {
+		if (queue_len[Q_FIRST] == 0)
+			return NULL;
+		frame = queue_front (Q_FIRST);
+		queue_del (frame);
+		ghost_add (frame, Q_FIRST, capacity / 2);
+		return frame;
+	}
+	return second_chance (Q_SECOND);
+}
+
+/* ARC. */
+
+static void
+arc_install (struct frame *frame) {
+	struct ghost *g = ghost_find (frame);
+	size_t delta;
+
+	if (g == NULL) {
+		/* Complete miss: keep T1 + B1 and the whole directory within
+		 * c and 2c pages. */
+		if (queue_len[Q_FIRST] + ghost_len[Q_FIRST] >= capacity)
+			ghost_drop_oldest (Q_FIRST);
+		else if (queue_len[Q_FIRST] + queue_len[Q_SECOND]
+				+ ghost_len[Q_FIRST] + ghost_len[Q_SECOND] >= 2 * capacity)
+			ghost_drop_oldest (Q_SECOND);
+		queue_push (frame, Q_FIRST);
+		return;
+	}
+
+	ghost_hit_cnt++;
+	if (g->queue == Q_FIRST) {
+		/* T1 was too small to keep this page: grow it. */
+		delta = ghost_len[Q_SECOND] / ghost_len[Q_FIRST];
+		delta = delta > 0 ? delta : 1;
+		arc_p = arc_p + delta < capacity ? arc_p + delta : capacity;
+	} else {
+		/* T2 was too small: shrink T1. */
+		delta = ghost_len[Q_FIRST] / ghost_len[Q_SECOND];
+		delta = delta > 0 ? delta : 1;
+		arc_p = arc_p > delta ? arc_p - delta : 0;
+	}
+	ghost_del (g);
+	queue_push (frame, Q_SECOND);
+}
+
+static struct frame *
+arc_victim (void) {
+	for (;;) {
+		struct frame *frame;
+		int q;
+
+		if (queue_len[Q_FIRST] > 0
+				&& (queue_len[Q_FIRST] >= (arc_p > 0 ? arc_p : 1)
+					|| queue_len[Q_SECOND] == 0))
+			q = Q_FIRST;
+		else if (queue_len[Q_SECOND] > 0)
+			q = Q_SECOND;
+		else
+			return NULL;
+
+		frame = queue_front (q);
+		queue_del (frame);
+		if (!frame_test_and_clear_accessed (frame)) {
+			ghost_add (frame, q, capacity);
+			return frame;
+		}
+		/* Referenced again: it belongs to the frequency list. */
+		queue_push (frame, Q_SECOND);
+	}
+}
+
+static const struct evict_policy policies[] = {
+	{"fifo", fifo_install, fifo_victim},
+	{"clock", fifo_install, clock_victim},
+	{"2q", twoq_install, twoq_victim},
+	{"arc", arc_install, arc_victim},
+	{NULL, NULL, NULL},
+};
+
+/* Policy in use.  Clock unless -evict says otherwise. */
+static const struct evict_policy *policy = &policies[1];
+
+/* Selects the replacement policy called NAME.  May be called before
+ * evict_init(), from the kernel command line.  Returns false if there
+ * is no such policy. */
+bool
+evict_select (const char *name) {
+	const struct evict_policy *p;
+
+	for (p = policies; p->name != NULL; p++)
+		if (!strcmp (p->name, name)) {
+			policy = p;
+			return true;
+		}
+	return false;
+}
+
+const char *
+evict_policy_name (void) {
+	return policy->name;
+}
+
+long long
+evict_ghost_hits (void) {
+	return ghost_hit_cnt;
+}
+
+/* Initializes the replacement policy's queues. */
+void
+evict_init (void) {
+	int q;
+
+	for (q = 0; q < Q_CNT; q++) {
+		list_init (&queues[q]);
+		list_init (&ghosts[q]);
+	}
+	hash_init (&ghost_table, ghost_hash, ghost_less, NULL);
+}
+
+/* Starts tracking FRAME, whose page has just been loaded. */
+void
+evict_install (struct frame *frame) {
+	ASSERT (frame->page != NULL);
+	ASSERT (frame->queue == Q_NONE);
+
+	policy->install (frame);
+	resident++;
+	if (resident > capacity)
+		capacity = resident;
+}
+
+/* Stops tracking FRAME, which is being freed. */
+void
+evict_remove (struct frame *frame) {
+	if (frame->queue == Q_NONE)
+		return;
+	queue_del (frame);
+	resident--;
+}
+
+/* Moves FRAME to the head of the first queue, where every policy looks
+ * for victims first, and forgets that it was accessed.  For pages that
+ * will not be used again soon. */
+void
+evict_deactivate (struct frame *frame) {
+	if (frame->queue == Q_NONE)
+		return;
+	queue_del (frame);
+	frame_test_and_clear_accessed (frame);
+	frame->queue = Q_FIRST;
+	list_push_front (&queues[Q_FIRST], &frame->f_elem);
+	queue_len[Q_FIRST]++;
+}
+
+/* Chooses a frame to evict and stops tracking it.  Returns NULL if
+ * there is no resident frame. */
+struct frame *
+evict_victim (void) {
+	struct frame *frame = policy->victim ();
+
+	if (frame != NULL)
+		resident--;
+	return frame;
+}
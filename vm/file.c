@@ -1,11 +1,20 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
 #include "userprog/process.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
 #include "threads/init.h"
 
+/* Most pages file_backed_writeback() copies out for one write. */
+#define WRITEBACK_PAGES 16
+
+static long long writeback_page_cnt;	/* # of pages written back. */
+static long long writeback_cnt;		/* # of writes they took. */
+
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
@@ -30,6 +39,7 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
@@ -53,22 +63,19 @@ static bool
 file_backed_swap_out (struct page *page) {
 	// printf("file swap out %p\n", page->va);
 	struct	file_page *file_page = &page->file;
+	bool dirty = vm_frame_clear_dirty (page->frame);
 
-	if (file_page->aux) {
+	/* Unmap before writing back, so that the owner cannot change the
+	 * page behind the write. */
+	pml4_clear_page(page->owner->pml4, pg_round_down (page->va));
+
+	if (file_page->aux && dirty) {
 		struct file_info *f_i = (struct file_info *)page->uninit.aux;
-		// printf("!!!%d\n", f_i->page_read_bytes);
-		// if (pml4_is_dirty(thread_current()->pml4, pg_round_down (page->va)) || pml4_is_dirty(base_pml4, page->frame->kva))
-		if (pml4_is_dirty(thread_current()->pml4, pg_round_down (page->va)))
-			file_write_at (f_i->file, pg_round_down (page->frame->kva), f_i->page_read_bytes, f_i->ofs);
+		vm_io_begin ();
+		file_write_at (f_i->file, pg_round_down (page->frame->kva), f_i->page_read_bytes, f_i->ofs);
+		vm_io_end ();
 	}
 
-	pml4_set_dirty(thread_current()->pml4, pg_round_down (page->va), 0);
-
-	pml4_clear_page(thread_current()->pml4, pg_round_down (page->va));
-	// pml4_set_dirty(base_pml4, page->frame->kva, 0);
-
-	// page->va = (void *)((uint64_t)page->va & ~PTE_P);
-
 	return true;
 }
 
@@ -78,17 +85,87 @@ file_backed_destroy (struct page *page) {
 	struct file_page *file_page = &page->file;
 	if (file_page->aux) {
 		struct file_info *f_i = (struct file_info *)page->file.aux;
-		if (pml4_is_dirty(thread_current()->pml4, page->va))
+		if (page->frame != NULL && vm_frame_clear_dirty (page->frame))
 			file_write_at (f_i->file, page->frame->kva, f_i->page_read_bytes, f_i->ofs);
 		free(file_page->aux);
 	}
 
-	pml4_clear_page(thread_current()->pml4, pg_round_down(page->va));
+	vm_free_frame (page);
+}
+
+/* Writes the LEN bytes at BUF to FILE at OFS, without vm_lock. */
+static void
+writeback_flush (struct file *file, const void *buf, off_t ofs, size_t len) {
+	if (len == 0)
+		return;
+	vm_io_begin ();
+	file_write_at (file, buf, len, ofs);
+	vm_io_end ();
+	writeback_cnt++;
+}
+
+/* Writes back the dirty pages among the CNT resident file-backed PAGES
+ * of the current process, which are in order of file offset.  Pages
+ * that follow each other in the same file are copied into one buffer
+ * and written with a single call, so a page that goes on changing
+ * cannot tear the write.  Called with vm_lock held, which is released
+ * during the writes; a page evicted meanwhile was written back by its
+ * eviction.  Returns false if there is no memory for the buffer. */
+bool
+file_backed_writeback (struct page *pages[], size_t cnt) {
+	size_t buf_size = WRITEBACK_PAGES * PGSIZE;
+	uint8_t *buf = palloc_get_multiple (0, WRITEBACK_PAGES);
+	struct file *run_file = NULL;
+	off_t run_ofs = 0;
+	size_t run_len = 0;
+	size_t i;
+
+	if (buf == NULL) {
+		buf_size = PGSIZE;
+		buf = palloc_get_page (0);
+		if (buf == NULL)
+			return false;
+	}
 
-	if (page->frame) {
-		list_remove(&page->frame->f_elem);
-		free (page->frame);
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+		struct file_info *f_i = page->file.aux;
+
+		if (f_i == NULL)
+			continue;
+		if (run_len > 0 && (f_i->file != run_file
+					|| f_i->ofs != run_ofs + (off_t) run_len
+					|| run_len + f_i->page_read_bytes > buf_size)) {
+			writeback_flush (run_file, buf, run_ofs, run_len);
+			run_len = 0;
+		}
+
+		/* Checked only now, since the flush may have let PAGE go. */
+		if (page->frame == NULL || page->busy
+				|| !vm_frame_clear_dirty (page->frame))
+			continue;
+		if (run_len == 0) {
+			run_file = f_i->file;
+			run_ofs = f_i->ofs;
+		}
+		memcpy (buf + run_len, page->frame->kva, f_i->page_read_bytes);
+		run_len += f_i->page_read_bytes;
+		writeback_page_cnt++;
 	}
+	writeback_flush (run_file, buf, run_ofs, run_len);
+
+	if (buf_size == PGSIZE)
+		palloc_free_page (buf);
+	else
+		palloc_free_multiple (buf, WRITEBACK_PAGES);
+	return true;
+}
+
+/* Print statistics about writeback of file-backed pages. */
+void
+vm_file_print_stats (void) {
+	printf ("Writeback: %lld pages in %lld writes\n", writeback_page_cnt,
+			writeback_cnt);
 }
 
 // /* Do the mmap */
@@ -0,0 +1,247 @@
+/* ksm.c: Same-page merging of anonymous frames.
+ *
+ * Processes started from the same program often end up with many
+ * anonymous pages that hold the same bytes.  With -ksm=PAGES, the
+ * ksmd thread goes round the frame table at low priority, PAGES frames
+ * every KSM_INTERVAL ticks, and lets frames with identical contents
+ * share one frame copy-on-write, like a fork does.  The first write to
+ * a merged page gets it a private copy again in vm_handle_wp().
+ *
+ * Frames are found by their contents: both tables hash a frame by a
+ * checksum of its page and compare frames with memcmp().
+ *
+ *   stable    frames already shared this way, and the zero frame.  All
+ *             their mappings are read-only, so they do not change.
+ *   unstable  frames seen once during this pass, still writable.  Their
+ *             contents may have changed since, so they are kept in
+ *             plain lists by the checksum they had, rather than in a
+ *             struct hash, and the lists are emptied after every pass.
+ *
+ * A frame is only considered if its checksum is the same as on the
+ * previous pass, so pages that change all the time are left alone.
+ * Before two frames are merged, both are write-protected and compared
+ * again.  Callers hold vm_lock. */
+
+#include "vm/ksm.h"
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "lib/kernel/hash.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+#define KSM_INTERVAL 10			/* Ticks between batches. */
+#define UNSTABLE_BUCKETS 256
+
+/* Where a frame is, in ksm_state. */
+enum ksm_state {
+	KSM_NONE,
+	KSM_UNSTABLE,
+	KSM_STABLE
+};
+
+size_t ksm_scan_rate;
+
+static struct hash stable_table;
+static struct list unstable_table[UNSTABLE_BUCKETS];
+static struct frame *zero;		/* vm.c's zero frame, always stable. */
+
+static long long page_cnt;		/* # of pages moved to a shared frame. */
+static long long freed_cnt;		/* # of frames freed by that. */
+static long long zero_cnt;		/* # of those pages that were all zeros. */
+static long long pass_cnt;		/* # of passes over the frame table. */
+
+static void ksm_daemon (void *aux);
+
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->ksm_sum;
+}
+
+static bool
+ksm_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, ksm_elem);
+	const struct frame *b = hash_entry (b_, struct frame, ksm_elem);
+	if (a->ksm_sum != b->ksm_sum)
+		return a->ksm_sum < b->ksm_sum;
+	return memcmp (a->kva, b->kva, PGSIZE) < 0;
+}
+
+/* Enters ZERO, the frame every all-zero page may share, in the stable
+ * table, and starts ksmd if merging is on. */
+void
+ksm_init (struct frame *zero_) {
+	size_t i;
+
+	hash_init (&stable_table, ksm_hash, ksm_less, NULL);
+	for (i = 0; i < UNSTABLE_BUCKETS; i++)
+		list_init (&unstable_table[i]);
+	zero = zero_;
+	zero->ksm_sum = hash_bytes (zero->kva, PGSIZE);
+	zero->ksm_state = KSM_STABLE;
+	hash_insert (&stable_table, &zero->ksm_elem);
+
+	if (ksm_scan_rate > 0
+			&& thread_create ("ksmd", PRI_MIN, ksm_daemon, NULL) == TID_ERROR)
+		PANIC ("ksm_init : cannot start merging thread");
+}
+
+/* Returns whether FRAME is a settled frame of anonymous pages, all
+ * writable and none in transit, that may be merged. */
+static bool
+ksm_candidate (struct frame *frame) {
+	struct list_elem *e;
+
+	if (frame->kva == NULL || frame->ref_cnt == 0 || frame->pin_cnt > 0
+			|| frame->text_inode != NULL)
+		return false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (VM_TYPE (page->operations->type) != VM_ANON || !page->writable
+				|| page->busy || page->owner->pml4 == NULL
+				|| page->owner->spt.dying)
+			return false;
+	}
+	return true;
+}
+
+/* Maps FRAME read-only everywhere, so that it stays as it is until a
+ * write fault, which waits for vm_lock. */
+static void
+frame_protect (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		pml4_set_writable (page->owner->pml4, page->va, false);
+	}
+}
+
+/* Returns the stable frame with the same contents as FRAME, or
+ * NULL. */
+static struct frame *
+stable_find (struct frame *frame) {
+	struct hash_elem *e = hash_find (&stable_table, &frame->ksm_elem);
+	return e != NULL ? hash_entry (e, struct frame, ksm_elem) : NULL;
+}
+
+/* Returns the unstable list for frames with checksum SUM. */
+static struct list *
+unstable_bucket (uint64_t sum) {
+	return &unstable_table[sum % UNSTABLE_BUCKETS];
+}
+
+/* Returns an unstable frame that now has the same contents as FRAME,
+ * or NULL. */
+static struct frame *
+unstable_find (struct frame *frame) {
+	struct list *bucket = unstable_bucket (frame->ksm_sum);
+	struct list_elem *e;
+
+	for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e)) {
+		struct frame *other = list_entry (e, struct frame, ksm_list_elem);
+
+		if (other->ksm_sum == frame->ksm_sum
+				&& !memcmp (other->kva, frame->kva, PGSIZE))
+			return other;
+	}
+	return NULL;
+}
+
+/* Looks at FRAME, the next one in the frame table, and merges it into
+ * a frame with the same contents if there is one. */
+void
+ksm_scan (struct frame *frame) {
+	struct frame *same;
+	uint64_t sum;
+
+	if (frame->ksm_state != KSM_NONE || !ksm_candidate (frame))
+		return;
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != frame->ksm_sum) {
+		frame->ksm_sum = sum;
+		return;
+	}
+
+	same = stable_find (frame);
+	if (same == NULL) {
+		same = unstable_find (frame);
+		if (same == NULL) {
+			frame->ksm_state = KSM_UNSTABLE;
+			list_push_back (unstable_bucket (sum), &frame->ksm_list_elem);
+			return;
+		}
+	}
+	if (same != zero && !ksm_candidate (same))
+		return;
+
+	frame_protect (frame);
+	if (same->ksm_state == KSM_UNSTABLE)
+		frame_protect (same);
+	if (memcmp (frame->kva, same->kva, PGSIZE)) {
+		/* SAME changed after it was entered. */
+		if (same->ksm_state == KSM_UNSTABLE)
+			ksm_forget (same);
+		return;
+	}
+	if (same->ksm_state == KSM_UNSTABLE) {
+		/* If a stable frame got the same contents meanwhile, SAME is
+		 * shared all the same, it just cannot be found. */
+		ksm_forget (same);
+		if (hash_insert (&stable_table, &same->ksm_elem) == NULL)
+			same->ksm_state = KSM_STABLE;
+	}
+
+	page_cnt += frame->ref_cnt;
+	if (same == zero)
+		zero_cnt += frame->ref_cnt;
+	freed_cnt++;
+	vm_frame_merge (frame, same);
+}
+
+/* Empties the unstable table after a pass over the frame table. */
+void
+ksm_pass_done (void) {
+	size_t i;
+
+	for (i = 0; i < UNSTABLE_BUCKETS; i++)
+		while (!list_empty (&unstable_table[i]))
+			list_entry (list_pop_front (&unstable_table[i]), struct frame,
+					ksm_list_elem)->ksm_state = KSM_NONE;
+	pass_cnt++;
+}
+
+/* Withdraws FRAME, which is about to be freed, reused or written. */
+void
+ksm_forget (struct frame *frame) {
+	ASSERT (frame != zero);
+
+	if (frame->ksm_state == KSM_STABLE)
+		hash_delete (&stable_table, &frame->ksm_elem);
+	else if (frame->ksm_state == KSM_UNSTABLE)
+		list_remove (&frame->ksm_list_elem);
+	frame->ksm_state = KSM_NONE;
+}
+
+/* Looks at ksm_scan_rate frames every KSM_INTERVAL ticks. */
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (KSM_INTERVAL);
+		vm_ksm_scan (ksm_scan_rate);
+	}
+}
+
+/* Print statistics about same-page merging. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %lld pages merged (%lld into the zero page), "
+			"%lld frames freed, %lld passes\n", page_cnt, zero_cnt, freed_cnt,
+			pass_cnt);
+}
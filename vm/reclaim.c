@@ -0,0 +1,76 @@
+/* reclaim.c: Background page reclaim.
+ *
+ * Without help, a fault that finds the user pool empty evicts frames
+ * itself and waits for their write-out.  The reclaim daemon tries to
+ * keep that from happening: when the number of free user frames drops
+ * below the low watermark it is woken, and it evicts clusters of
+ * frames, writing back dirty file pages and swapping out anonymous
+ * ones, until the high watermark is reached again.
+ *
+ * The daemon leaves high_wm swap slots for the faults themselves, so
+ * reclaiming ahead of demand never fills swap that direct reclaim
+ * would have managed with. */
+
+#include "vm/reclaim.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+size_t reclaim_low_wm = SIZE_MAX;
+size_t reclaim_high_wm = SIZE_MAX;
+
+static struct semaphore reclaim_sema;	/* Upped to wake the daemon. */
+static bool reclaim_running;			/* Daemon awake or being woken. */
+
+static void reclaim_daemon (void *aux);
+
+/* Fills in default watermarks and starts the reclaim daemon. */
+void
+reclaim_init (void) {
+	size_t pool_cnt = palloc_user_free_cnt ();
+
+	if (reclaim_low_wm == SIZE_MAX) {
+		reclaim_low_wm = pool_cnt / 64;
+		if (reclaim_low_wm < SWAP_CLUSTER)
+			reclaim_low_wm = SWAP_CLUSTER;
+	}
+	if (reclaim_high_wm == SIZE_MAX)
+		reclaim_high_wm = 2 * reclaim_low_wm;
+	if (reclaim_high_wm < reclaim_low_wm)
+		reclaim_high_wm = reclaim_low_wm;
+	if (reclaim_low_wm == 0)
+		return;
+
+	sema_init (&reclaim_sema, 0);
+	reclaim_running = true;
+	if (thread_create ("reclaimd", PRI_DEFAULT, reclaim_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("reclaim_init : cannot start reclaim daemon");
+}
+
+/* Wakes the daemon if free user frames are below the low watermark.
+ * Cheap enough to call after every frame allocation. */
+void
+reclaim_wake (void) {
+	if (reclaim_running || palloc_user_free_cnt () >= reclaim_low_wm)
+		return;
+	reclaim_running = true;
+	sema_up (&reclaim_sema);
+}
+
+/* Reclaims frames up to the high watermark each time it is woken. */
+static void
+reclaim_daemon (void *aux UNUSED) {
+	for (;;) {
+		reclaim_running = false;
+		sema_down (&reclaim_sema);
+
+		while (palloc_user_free_cnt () < reclaim_high_wm
+				&& anon_swap_has_room (reclaim_high_wm))
+			if (vm_reclaim () == 0)
+				break;
+	}
+}
@@ -0,0 +1,368 @@
+/* swap.c: Swap space on one or more disks.
+ *
+ * Each swap disk is divided into page-sized slots, numbered one after
+ * the other across all the disks, so that a slot number alone says
+ * where a page is.  The slots taken together by one swap_alloc() are
+ * always on the same disk, and can be moved with a single transfer.
+ *
+ * Free slots are found with a tree over each disk's allocation bitmap,
+ * which it keeps as 64-bit words, one word per leaf.  Each node knows
+ * the longest free run below it and the free runs at both of its ends,
+ * so the first free run of a given length is found in O(log n) steps,
+ * and taking or freeing slots updates one path to the root per word.
+ *
+ * Disks are added with -swap=CHAN:DEV[:PRIO]; without it, hd1:1 is
+ * used.  Slots come from the disks of the highest priority that have
+ * room, taking them in turn, so that disks of equal priority on
+ * different channels share the transfers.  A disk of lower priority is
+ * used only once all the higher ones are full. */
+
+#include "vm/swap.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+#define SWAP_DEV_MAX 4			/* Most swap disks. */
+#define WORD_BITS 64			/* Slots per bitmap word. */
+
+/* Free runs in the slots below a tree node. */
+struct run_node {
+	uint32_t longest;			/* Longest free run. */
+	uint32_t prefix;			/* Free slots at the start. */
+	uint32_t suffix;			/* Free slots at the end. */
+};
+
+/* A swap disk. */
+struct swap_dev {
+	int chan_no, dev_no;
+	int prio;					/* Higher is used first. */
+	struct disk *disk;
+	size_t base;				/* Number of its first slot. */
+	size_t slot_cnt;
+	size_t used_cnt;			/* Slots now in use. */
+	uint64_t *words;			/* A set bit is a slot in use. */
+	size_t leaf_cnt;			/* Leaves of TREE, a power of 2. */
+	struct run_node *tree;		/* Root at 1, leaf I at LEAF_CNT + I. */
+	long long out_cnt;			/* # of pages written to it. */
+	long long in_cnt;			/* # of pages read from it. */
+};
+
+/* Disks by decreasing priority.  The allocation state is protected
+ * by swap_lock, which is never held across a disk transfer. */
+static struct swap_dev devs[SWAP_DEV_MAX];
+static size_t dev_cnt;
+static size_t slot_cnt;
+static size_t used_cnt;
+static size_t peak_cnt;			/* Most slots ever in use at once. */
+static unsigned next_turn;		/* Picks among disks of one priority. */
+static struct lock swap_lock;
+
+/* Adds the swap disk given by SPEC, CHAN:DEV or CHAN:DEV:PRIO.  Called
+ * while parsing the command line, before the disks are probed.
+ * Returns false if SPEC is malformed or too many disks are given. */
+bool
+swap_add (const char *spec) {
+	struct swap_dev *d = &devs[dev_cnt];
+	const char *p;
+
+	if (spec == NULL || dev_cnt >= SWAP_DEV_MAX
+			|| (p = strchr (spec, ':')) == NULL)
+		return false;
+	d->chan_no = atoi (spec);
+	d->dev_no = atoi (p + 1);
+	p = strchr (p + 1, ':');
+	d->prio = p != NULL ? atoi (p + 1) : 0;
+	if (d->chan_no < 0 || (d->dev_no != 0 && d->dev_no != 1))
+		return false;
+	dev_cnt++;
+	return true;
+}
+
+/* Returns the free runs of a leaf whose slots are given by WORD. */
+static struct run_node
+leaf_runs (uint64_t word) {
+	struct run_node n;
+	uint64_t bits = ~word;
+
+	n.prefix = word == 0 ? WORD_BITS : __builtin_ctzll (word);
+	n.suffix = word == 0 ? WORD_BITS : __builtin_clzll (word);
+	/* Each step shortens every run of set bits in BITS by one. */
+	for (n.longest = 0; bits != 0; n.longest++)
+		bits &= bits >> 1;
+	return n;
+}
+
+/* Recomputes the runs of D's tree above bitmap word W. */
+static void
+tree_update (struct swap_dev *d, size_t w) {
+	size_t node = d->leaf_cnt + w;
+	uint32_t span = WORD_BITS;		/* Slots below each child. */
+
+	d->tree[node] = leaf_runs (d->words[w]);
+	for (node /= 2; node > 0; node /= 2, span *= 2) {
+		const struct run_node *l = &d->tree[2 * node];
+		const struct run_node *r = &d->tree[2 * node + 1];
+		struct run_node *n = &d->tree[node];
+
+		n->longest = l->longest > r->longest ? l->longest : r->longest;
+		if (l->suffix + r->prefix > n->longest)
+			n->longest = l->suffix + r->prefix;
+		n->prefix = l->prefix == span ? span + r->prefix : l->prefix;
+		n->suffix = r->suffix == span ? span + l->suffix : r->suffix;
+	}
+}
+
+/* Marks the CNT slots of D starting at SLOT, counted from the start of
+ * D, as used or free. */
+static void
+dev_mark (struct swap_dev *d, size_t slot, size_t cnt, bool used) {
+	while (cnt > 0) {
+		size_t w = slot / WORD_BITS;
+		size_t ofs = slot % WORD_BITS;
+		size_t n = cnt < WORD_BITS - ofs ? cnt : WORD_BITS - ofs;
+		uint64_t mask = (n == WORD_BITS ? ~0ULL : (1ULL << n) - 1) << ofs;
+
+		ASSERT ((d->words[w] & mask) == (used ? 0 : mask));
+		if (used)
+			d->words[w] |= mask;
+		else
+			d->words[w] &= ~mask;
+		tree_update (d, w);
+		slot += n;
+		cnt -= n;
+	}
+}
+
+/* Returns the first of CNT free slots in a row on D, counted from the
+ * start of D, or SWAP_ERROR.  CNT is at most WORD_BITS. */
+static size_t
+dev_find (struct swap_dev *d, size_t cnt) {
+	size_t node = 1, start = 0;
+	size_t span = d->leaf_cnt * WORD_BITS;
+	uint64_t bits;
+
+	if (d->tree[1].longest < cnt)
+		return SWAP_ERROR;
+	while (node < d->leaf_cnt) {
+		const struct run_node *l = &d->tree[2 * node];
+		const struct run_node *r = &d->tree[2 * node + 1];
+
+		span /= 2;
+		if (l->longest >= cnt)
+			node = 2 * node;
+		else if (l->suffix + r->prefix >= cnt)
+			return start + span - l->suffix;
+		else {
+			node = 2 * node + 1;
+			start += span;
+		}
+	}
+
+	/* Bit I of BITS ends up set if slots I to I + CNT - 1 are free. */
+	bits = ~d->words[node - d->leaf_cnt];
+	while (--cnt > 0)
+		bits &= bits >> 1;
+	return start + __builtin_ctzll (bits);
+}
+
+/* Probes disk D and sets up its bitmap and tree.  Slots past the end
+ * of the disk are marked used for good. */
+static bool
+dev_init (struct swap_dev *d) {
+	size_t word_cnt, i;
+
+	d->disk = disk_get (d->chan_no, d->dev_no);
+	if (d->disk == NULL)
+		return false;
+	d->slot_cnt = disk_size (d->disk) / SECTORS_PER_SLOT;
+	word_cnt = DIV_ROUND_UP (d->slot_cnt, WORD_BITS);
+	for (d->leaf_cnt = 1; d->leaf_cnt < word_cnt; d->leaf_cnt *= 2)
+		continue;
+	d->words = malloc (d->leaf_cnt * sizeof *d->words);
+	d->tree = calloc (2 * d->leaf_cnt, sizeof *d->tree);
+	if (d->words == NULL || d->tree == NULL)
+		PANIC ("swap_init : out of memory");
+
+	for (i = 0; i < d->leaf_cnt; i++) {
+		size_t first = i * WORD_BITS;
+
+		if (first + WORD_BITS <= d->slot_cnt)
+			d->words[i] = 0;
+		else if (first >= d->slot_cnt)
+			d->words[i] = ~0ULL;
+		else
+			d->words[i] = ~0ULL << (d->slot_cnt - first);
+		tree_update (d, i);
+	}
+	return true;
+}
+
+/* Probes the swap disks, hd1:1 if none was given. */
+void
+swap_init (void) {
+	size_t i, j;
+
+	lock_init (&swap_lock);
+	if (dev_cnt == 0) {
+		swap_add ("1:1");
+		if (!dev_init (&devs[0])) {
+			dev_cnt = 0;
+			return;
+		}
+	} else
+		for (i = 0; i < dev_cnt; i++)
+			if (!dev_init (&devs[i]))
+				PANIC ("swap disk hd%d:%d not found", devs[i].chan_no,
+						devs[i].dev_no);
+
+	/* Sort by priority, keeping the order they were given in. */
+	for (i = 1; i < dev_cnt; i++)
+		for (j = i; j > 0 && devs[j - 1].prio < devs[j].prio; j--) {
+			struct swap_dev tmp = devs[j];
+			devs[j] = devs[j - 1];
+			devs[j - 1] = tmp;
+		}
+	for (i = 0; i < dev_cnt; i++) {
+		devs[i].base = slot_cnt;
+		slot_cnt += devs[i].slot_cnt;
+	}
+}
+
+/* Returns the disk holding SLOT. */
+static struct swap_dev *
+slot_dev (size_t slot) {
+	size_t i;
+
+	for (i = dev_cnt; i-- > 0; )
+		if (slot >= devs[i].base)
+			return &devs[i];
+	NOT_REACHED ();
+}
+
+/* Takes CNT free slots in a row, at most SWAP_CLUSTER, all on one
+ * disk, and returns the first, or SWAP_ERROR if no disk has such a
+ * run. */
+size_t
+swap_alloc (size_t cnt) {
+	size_t first, i, k;
+
+	ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+	lock_acquire (&swap_lock);
+	for (first = 0; first < dev_cnt; first = i) {
+		size_t group;
+
+		for (i = first; i < dev_cnt && devs[i].prio == devs[first].prio; i++)
+			continue;
+		group = i - first;
+		for (k = 0; k < group; k++) {
+			struct swap_dev *d = &devs[first + (next_turn + k) % group];
+			size_t slot = dev_find (d, cnt);
+
+			if (slot != SWAP_ERROR) {
+				dev_mark (d, slot, cnt, true);
+				d->used_cnt += cnt;
+				used_cnt += cnt;
+				if (used_cnt > peak_cnt)
+					peak_cnt = used_cnt;
+				next_turn++;
+				lock_release (&swap_lock);
+				return d->base + slot;
+			}
+		}
+	}
+	lock_release (&swap_lock);
+	return SWAP_ERROR;
+}
+
+/* Gives back the CNT slots starting at SLOT, which were taken
+ * together or are otherwise all on one disk. */
+void
+swap_free (size_t slot, size_t cnt) {
+	struct swap_dev *d;
+
+	lock_acquire (&swap_lock);
+	d = slot_dev (slot);
+	ASSERT (slot + cnt <= d->base + d->slot_cnt);
+	dev_mark (d, slot - d->base, cnt, false);
+	d->used_cnt -= cnt;
+	used_cnt -= cnt;
+	lock_release (&swap_lock);
+}
+
+/* Returns the number of slots on all swap disks. */
+size_t
+swap_slot_cnt (void) {
+	return slot_cnt;
+}
+
+/* Returns the number of slots not in use. */
+size_t
+swap_free_cnt (void) {
+	return slot_cnt - used_cnt;
+}
+
+/* Returns the slot after the last one on the disk holding SLOT.  A run
+ * of slots read or written together may not go past it. */
+size_t
+swap_dev_end (size_t slot) {
+	struct swap_dev *d = slot_dev (slot);
+
+	return d->base + d->slot_cnt;
+}
+
+/* Moves CNT pages between the page frames at KVAS and consecutive
+ * swap slots starting at SLOT, in one multi-sector transfer.  Releases
+ * vm_lock meanwhile. */
+void
+swap_transfer (size_t slot, void *const kvas[], size_t cnt, bool write) {
+	struct swap_dev *d = slot_dev (slot);
+	disk_sector_t sector = (slot - d->base) * SECTORS_PER_SLOT;
+	void **sectors;
+	size_t i;
+
+	ASSERT (cnt <= SWAP_CLUSTER);
+	ASSERT (slot + cnt <= d->base + d->slot_cnt);
+
+	/* Several transfers may be in flight, so the buffer list is ours. */
+	sectors = malloc (cnt * SECTORS_PER_SLOT * sizeof *sectors);
+	if (sectors == NULL)
+		PANIC ("swap_transfer : out of memory");
+	for (i = 0; i < cnt * SECTORS_PER_SLOT; i++)
+		sectors[i] = kvas[i / SECTORS_PER_SLOT]
+			+ DISK_SECTOR_SIZE * (i % SECTORS_PER_SLOT);
+
+	if (write)
+		d->out_cnt += cnt;
+	else
+		d->in_cnt += cnt;
+	vm_io_begin ();
+	if (write)
+		disk_write_multiple (d->disk, sector, sectors, cnt * SECTORS_PER_SLOT);
+	else
+		disk_read_multiple (d->disk, sector, sectors, cnt * SECTORS_PER_SLOT);
+	vm_io_end ();
+	free (sectors);
+}
+
+/* Prints statistics about swap space. */
+void
+swap_print_stats (void) {
+	size_t i;
+
+	printf ("Swap space: %zu of %zu slots in use, at most %zu, on %zu "
+			"disks\n", used_cnt, slot_cnt, peak_cnt, dev_cnt);
+	for (i = 0; i < dev_cnt; i++)
+		printf ("  hd%d:%d priority %d: %zu of %zu slots in use, "
+				"%lld pages out, %lld in\n", devs[i].chan_no, devs[i].dev_no,
+				devs[i].prio, devs[i].used_cnt, devs[i].slot_cnt,
+				devs[i].out_cnt, devs[i].in_cnt);
+}
@@ -2,4 +2,11 @@ vm_SRC = vm/vm.c          # Main api proxy
 vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
+vm_SRC += vm/evict.c      # Page replacement policies
+vm_SRC += vm/reclaim.c    # Background page reclaim
+vm_SRC += vm/text.c       # Shared program text
+vm_SRC += vm/vma.c        # Address-space regions
+vm_SRC += vm/zswap.c      # Compressed swap cache
+vm_SRC += vm/swap.c       # Swap space allocator
+vm_SRC += vm/ksm.c        # Same-page merging
 vm_SRC += vm/inspect.c    # Testing utility
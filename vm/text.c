@@ -0,0 +1,123 @@
+/* text.c: Read-only executable pages shared between processes.
+ *
+ * Every process running a program used to read its own copy of the
+ * program's code.  Instead, a read-only page loaded from an ELF
+ * segment is entered here, keyed by the inode, offset and length it was
+ * read from, and a later process faulting on the same page maps the
+ * same frame.  The frame's page list counts the sharers as it does for
+ * copy-on-write.
+ *
+ * Such pages are never dirty, so eviction drops them rather than
+ * writing them to swap; see anon.c.  So are the writable pages of ELF
+ * data until they are first written: they are mapped read-only till
+ * then, and only become ordinary anonymous pages in vm_handle_wp().
+ * Callers hold vm_lock. */
+
+#include "vm/text.h"
+#include "filesys/file.h"
+#include "lib/kernel/hash.h"
+#include "userprog/process.h"
+#include "vm/vm.h"
+
+static struct hash text_table;
+static long long hit_cnt;
+
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *f = hash_entry (e, struct frame, text_elem);
+	return hash_bytes (&f->text_inode, sizeof f->text_inode)
+		^ hash_int (f->text_ofs) ^ hash_int (f->text_bytes);
+}
+
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, text_elem);
+	const struct frame *b = hash_entry (b_, struct frame, text_elem);
+	if (a->text_inode != b->text_inode)
+		return a->text_inode < b->text_inode;
+	if (a->text_ofs != b->text_ofs)
+		return a->text_ofs < b->text_ofs;
+	return a->text_bytes < b->text_bytes;
+}
+
+void
+text_init (void) {
+	hash_init (&text_table, text_hash, text_less, NULL);
+}
+
+/* Returns whether PAGE is a page of an ELF segment, whatever state it
+ * is in.  Uninit and anonymous pages keep INIT and AUX in the same
+ * place, so this holds across the first fault. */
+static bool
+exec_page (struct page *page) {
+	return page_get_type (page) == VM_ANON
+		&& page->uninit.init == lazy_load_segment
+		&& page->uninit.aux != NULL;
+}
+
+/* Returns whether PAGE is a read-only page of an ELF segment. */
+bool
+text_page (struct page *page) {
+	return !page->writable && exec_page (page);
+}
+
+/* Returns whether PAGE is a page of an ELF segment that holds just
+ * what it was read from the executable, or has yet to be read: program
+ * text, or data that has not been written. */
+bool
+exec_page_clean (struct page *page) {
+	if (!exec_page (page))
+		return false;
+	return VM_TYPE (page->operations->type) == VM_UNINIT || page->anon.clean;
+}
+
+/* Sets the key of FRAME to where text page PAGE is read from. */
+static void
+text_key (struct frame *frame, struct page *page) {
+	struct file_info *fi = page->uninit.aux;
+
+	frame->text_inode = file_get_inode (fi->file);
+	frame->text_ofs = fi->ofs;
+	frame->text_bytes = fi->page_read_bytes;
+}
+
+/* Returns the frame already holding the contents of PAGE, or NULL. */
+struct frame *
+text_find (struct page *page) {
+	struct frame key;
+	struct hash_elem *e;
+
+	if (!text_page (page))
+		return NULL;
+	text_key (&key, page);
+	e = hash_find (&text_table, &key.text_elem);
+	if (e == NULL)
+		return NULL;
+	hit_cnt++;
+	return hash_entry (e, struct frame, text_elem);
+}
+
+/* Offers FRAME, into which PAGE has just been loaded, for sharing. */
+void
+text_insert (struct page *page, struct frame *frame) {
+	if (!text_page (page) || frame->text_inode != NULL)
+		return;
+	text_key (frame, page);
+	if (hash_insert (&text_table, &frame->text_elem) != NULL)
+		frame->text_inode = NULL;
+}
+
+/* Withdraws FRAME, which is about to be freed or reused. */
+void
+text_remove (struct frame *frame) {
+	if (frame->text_inode == NULL)
+		return;
+	hash_delete (&text_table, &frame->text_elem);
+	frame->text_inode = NULL;
+}
+
+long long
+text_hits (void) {
+	return hit_cnt;
+}
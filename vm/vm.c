@@ -1,16 +1,78 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "threads/pte.h"
 #include "threads/mmu.h"
 #include "threads/init.h"
 #include "vm/vm.h"
+#include "vm/evict.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/reclaim.h"
+#include "vm/text.h"
+#include "vm/vma.h"
 
 #include "userprog/process.h"
 
-static struct list frame_list;
+/* Serializes fault handling, eviction and frame teardown.  Released
+ * across the disk I/O they do; a page in transit is marked busy
+ * instead, so it cannot be faulted back in or evicted meanwhile. */
+static struct lock vm_lock;
+
+/* Signalled whenever a page stops being busy.  A thread that needs a
+ * busy page waits here; see page_wait(). */
+static struct condition page_done;
+
+static long long fault_cnt;		/* # of page faults handled. */
+static long long evict_cnt;		/* # of frames evicted. */
+static long long direct_cnt;	/* # of evictions done by a fault. */
+static long long nowait_cnt;	/* # of faults that did not evict. */
+static long long reclaim_cnt;	/* # of frames freed by the daemon. */
+static long long around_cnt;	/* # of pages loaded by fault-around. */
+static long long zero_map_cnt;	/* # of pages mapped to zero_frame. */
+static long long zero_copy_cnt;	/* # of those written later. */
+static long long region_page_cnt;	/* # of pages created from regions. */
+static long long huge_cnt;		/* # of huge pages mapped. */
+static long long prefetch_cnt;	/* # of pages read in for MADV_WILLNEED. */
+static long long populate_cnt;	/* # of pages read in for MAP_POPULATE. */
+static long long discard_cnt;	/* # of pages freed by MADV_DONTNEED. */
+static long long behind_cnt;	/* # of pages put first in line to evict. */
+static long long teardown_cnt;	/* # of pages destroyed at exit. */
+
+/* Pages queued by MADV_WILLNEED, and the condition the prefetch thread
+ * waits on for more.  Both under vm_lock. */
+static struct list prefetch_queue;
+static struct condition prefetch_ready;
+
+/* -hugepages: map untouched, aligned 2 MiB stretches of anonymous
+ * zero-fill regions with one huge page each. */
+bool vm_huge_pages;
+
+/* All-zero frame mapped read-only by every anonymous page that has been
+ * read but never written.  It is never evicted or freed. */
+static struct frame zero_frame;
+
+/* Frame table: one struct frame for every page of the user pool, so
+ * that the frame holding a kva is found by indexing. */
+static struct frame *frame_table;
+static uint8_t *frame_base;		/* First page of the user pool. */
+static size_t frame_cnt;
+static size_t ksm_next;			/* Next frame for ksm_scan(). */
+
+/* Fault-around starts once a run has continued FAULT_AROUND_SEQ times,
+ * with a window of FAULT_AROUND_MIN pages, and the window doubles with
+ * every further fault up to FAULT_AROUND_MAX.  Until then each fault
+ * loads just its own page, so scattered accesses stay demand paged. */
+#define FAULT_AROUND_SEQ 2
+#define FAULT_AROUND_MIN 4
+#define FAULT_AROUND_MAX 32
+
+static void prefetch_daemon (void *aux);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -18,13 +80,28 @@ void
 vm_init (void) {
 	vm_anon_init ();
 	vm_file_init ();
-	list_init(&frame_list);
+	evict_init ();
+	text_init ();
 #ifdef EFILESYS  /* For project 4 */
 	pagecache_init ();
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
+	lock_init (&vm_lock);
+	cond_init (&page_done);
+	frame_base = palloc_user_pool (&frame_cnt);
+	frame_table = palloc_get_multiple (PAL_ZERO | PAL_ASSERT,
+			DIV_ROUND_UP (frame_cnt * sizeof *frame_table, PGSIZE));
+	zero_frame.kva = palloc_get_page (PAL_ZERO | PAL_ASSERT);
+	list_init (&zero_frame.pages);
+	ksm_init (&zero_frame);
+	list_init (&prefetch_queue);
+	cond_init (&prefetch_ready);
+	reclaim_init ();
+	if (thread_create ("prefetchd", PRI_DEFAULT, prefetch_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("vm_init : cannot start prefetch thread");
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -45,6 +122,16 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static bool vm_handle_fault (struct intr_frame *f, void *addr, bool user,
+		bool write, bool not_present);
+static bool vm_share_text (struct page *page);
+static void page_wait (struct page *page);
+static bool page_is_zero_fill (struct page *page);
+static bool page_map_rw (struct page *page);
+static bool vm_load_ahead (struct page *page);
+static bool vm_map_huge (struct supplemental_page_table *spt, void *addr);
+static struct page *spt_create_page (struct supplemental_page_table *spt,
+		struct vma *vma, void *va);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -57,7 +144,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
 
-	if (spt_find_page (spt, upage) == NULL) {
+	if (spt_lookup_page (spt, upage) == NULL) {
 		struct page *page = (struct page *)calloc(sizeof(struct page), 1);
 		if (page == NULL)
 			goto err;
@@ -72,6 +159,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		}
 
 		page->writable = writable;
+		page->owner = thread_current ();
 
 		if (!spt_insert_page(spt, page))
 			goto err;
@@ -82,9 +170,23 @@ err:
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
+/* Find VA from spt and return page. On error, return NULL.
+ * A page of the current process that lies in one of its regions but
+ * has never been looked up is created here. */
 struct page *
 spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page *page = spt_lookup_page (spt, va);
+	struct vma *vma;
+
+	if (page != NULL || spt != &thread_current ()->spt)
+		return page;
+	vma = vma_find (spt, va);
+	return vma != NULL ? spt_create_page (spt, vma, pg_round_down (va)) : NULL;
+}
+
+/* Like spt_find_page(), but only finds pages that already exist. */
+struct page *
+spt_lookup_page (struct supplemental_page_table *spt, void *va) {
 	struct page p;
 	struct hash_elem *e;
 
@@ -93,6 +195,236 @@ spt_find_page (struct supplemental_page_table *spt, void *va) {
 	return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
 }
 
+/* Creates the page at VA in region VMA of SPT, describing where in the
+ * region's file its contents are, as load_segment() used to for every
+ * page up front. */
+static struct page *
+spt_create_page (struct supplemental_page_table *spt, struct vma *vma,
+		void *va) {
+	struct file_info *fi = NULL;
+
+	if (vma->file != NULL) {
+		size_t ofs = va - vma->start;
+
+		fi = calloc (1, sizeof *fi);
+		if (fi == NULL)
+			return NULL;
+		fi->file = vma->file;
+		fi->read_bytes = ofs < vma->read_bytes ? vma->read_bytes - ofs : 0;
+		fi->ofs = vma->ofs + (vma->read_bytes - fi->read_bytes);
+		fi->page_read_bytes = fi->read_bytes < PGSIZE ? fi->read_bytes : PGSIZE;
+		fi->page_zero_bytes = PGSIZE - fi->page_read_bytes;
+	}
+	if (!vm_alloc_page_with_initializer (vma->type, va, vma->writable,
+				vma->init, fi)) {
+		free (fi);
+		return NULL;
+	}
+	region_page_cnt++;
+	return spt_lookup_page (spt, va);
+}
+
+/* Pages of a mapping gathered for one file_backed_writeback() call. */
+#define WRITEBACK_BATCH 64
+
+/* Writes back the dirty file-backed pages of SPT from START to END,
+ * coalescing pages that are contiguous in their file.  Pages of one
+ * region are in file order already.  Returns false if memory is
+ * short. */
+static bool
+spt_writeback (struct supplemental_page_table *spt, void *start, void *end) {
+	struct page *pages[WRITEBACK_BATCH];
+	void *va = start;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	while (va < end) {
+		size_t cnt = 0;
+
+		for (; va < end && cnt < WRITEBACK_BATCH; va += PGSIZE) {
+			struct page *page = spt_lookup_page (spt, va);
+
+			if (page != NULL && page->frame != NULL
+					&& VM_TYPE (page->operations->type) == VM_FILE)
+				pages[cnt++] = page;
+		}
+		if (cnt > 0 && !file_backed_writeback (pages, cnt))
+			return false;
+	}
+	return true;
+}
+
+/* Destroys the pages of SPT from START to END.  Stops early once SPT
+ * has no pages left, so a large region that was barely touched costs
+ * little at exit. */
+static void
+spt_destroy_range (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	void *va;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	for (va = start; va < end && !hash_empty (&spt->h); va += PGSIZE) {
+		struct page *page = spt_lookup_page (spt, va);
+
+		if (page != NULL) {
+			page_wait (page);
+			hash_delete (&spt->h, &page->hash_elem);
+			vm_dealloc_page (page);
+		}
+	}
+}
+
+/* Removes the file mapping that starts at ADDR, writing back its dirty
+ * pages.  Does nothing if no mapping starts there. */
+void
+spt_unmap (struct supplemental_page_table *spt, void *addr) {
+	struct vma *vma = vma_find (spt, addr);
+
+	if (vma == NULL || vma->start != addr || VM_TYPE (vma->type) != VM_FILE)
+		return;
+
+	lock_acquire (&vm_lock);
+	/* Pages still dirty after this, if memory was short, are written
+	 * back one by one as they are destroyed. */
+	spt_writeback (spt, vma->start, vma->end);
+	spt_destroy_range (spt, vma->start, vma->end);
+	vma_remove (spt, vma);
+	lock_release (&vm_lock);
+}
+
+/* Queues the pages from START to END that are not resident for the
+ * prefetch thread, no more than there are free frames for. */
+static void
+spt_willneed (struct supplemental_page_table *spt, void *start, void *end) {
+	size_t room = palloc_user_free_cnt ();
+	void *va;
+
+	lock_acquire (&vm_lock);
+	for (va = start; va < end && room > 0; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page == NULL || page->frame != NULL || page->busy
+				|| page->prefetch || page_is_zero_fill (page))
+			continue;
+		page->prefetch = true;
+		list_push_back (&prefetch_queue, &page->prefetch_elem);
+		room--;
+	}
+	cond_signal (&prefetch_ready, &vm_lock);
+	lock_release (&vm_lock);
+}
+
+/* Frees the pages from START to END, with their frames and swap slots.
+ * Touched again, they start over from their regions: zeros for
+ * anonymous memory, the file's contents for file-backed memory. */
+static void
+spt_discard (struct supplemental_page_table *spt, void *start, void *end) {
+	void *va;
+
+	lock_acquire (&vm_lock);
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_lookup_page (spt, va);
+
+		if (page != NULL) {
+			page_wait (page);
+			hash_delete (&spt->h, &page->hash_elem);
+			vm_dealloc_page (page);
+			discard_cnt++;
+		}
+	}
+	lock_release (&vm_lock);
+}
+
+/* Returns whether the page-aligned ADDR and the LENGTH bytes after it
+ * lie within regions of SPT, and sets *END to the end of the last page
+ * they touch. */
+static bool
+spt_range_mapped (struct supplemental_page_table *spt, void *addr,
+		size_t length, void **end) {
+	struct vma *vma;
+	void *va;
+
+	*end = addr + ROUND_UP (length, PGSIZE);
+	if (pg_ofs (addr) != 0 || length == 0 || *end <= addr
+			|| !is_user_vaddr (*end - 1))
+		return false;
+	for (va = addr; va < *end; va = vma->end) {
+		vma = vma_find (spt, va);
+		if (vma == NULL)
+			return false;
+	}
+	return true;
+}
+
+/* Writes back the dirty file-backed pages among the LENGTH bytes at
+ * ADDR in SPT, for msync().  Returns false if part of the range lies
+ * outside all regions or memory is short. */
+bool
+spt_msync (struct supplemental_page_table *spt, void *addr, size_t length) {
+	void *end;
+	bool success;
+
+	if (!spt_range_mapped (spt, addr, length, &end))
+		return false;
+	lock_acquire (&vm_lock);
+	success = spt_writeback (spt, addr, end);
+	lock_release (&vm_lock);
+	return success;
+}
+
+/* Carries out madvise() ADVICE for the LENGTH bytes at ADDR in SPT.
+ * MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are kept per region and
+ * apply to every region the range touches.  Returns false if ADVICE is
+ * unknown or part of the range lies outside all regions. */
+bool
+spt_advise (struct supplemental_page_table *spt, void *addr, size_t length,
+		int advice) {
+	struct vma *vma;
+	void *end, *va;
+
+	if (advice < MADV_NORMAL || advice > MADV_DONTNEED
+			|| !spt_range_mapped (spt, addr, length, &end))
+		return false;
+
+	switch (advice) {
+		case MADV_WILLNEED:
+			spt_willneed (spt, addr, end);
+			break;
+		case MADV_DONTNEED:
+			spt_discard (spt, addr, end);
+			break;
+		default:
+			for (va = addr; va < end; va = vma->end) {
+				vma = vma_find (spt, va);
+				vma->advice = advice;
+			}
+			break;
+	}
+	return true;
+}
+
+/* Reads in every page of the LENGTH bytes at ADDR in SPT, for mmap()
+ * with MAP_POPULATE.  Stops at the first page outside all regions. */
+void
+spt_populate (struct supplemental_page_table *spt, void *addr,
+		size_t length) {
+	void *va;
+
+	lock_acquire (&vm_lock);
+	for (va = addr; va < addr + length; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page == NULL)
+			break;
+		page_wait (page);
+		if (page->frame == NULL && !vm_do_claim_page (page))
+			break;
+		populate_cnt++;
+	}
+	lock_release (&vm_lock);
+}
+
 /* Insert PAGE into spt with validation. */
 bool
 spt_insert_page (struct supplemental_page_table *spt,
@@ -102,113 +434,836 @@ spt_insert_page (struct supplemental_page_table *spt,
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	lock_acquire (&vm_lock);
+	page_wait (page);
 	vm_dealloc_page (page);
-	return true;
+	lock_release (&vm_lock);
+}
+
+/* Releases vm_lock for a disk transfer, so that faults elsewhere can go
+ * on meanwhile.  The pages involved must be busy, or their frames off
+ * the eviction queues, so nobody else touches them until vm_io_end(). */
+void
+vm_io_begin (void) {
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+	lock_release (&vm_lock);
+}
+
+/* Takes vm_lock back after vm_io_begin(). */
+void
+vm_io_end (void) {
+	lock_acquire (&vm_lock);
+}
+
+/* Marks PAGE busy while it is in transit, or done with that. */
+void
+vm_page_set_busy (struct page *page, bool busy) {
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+	ASSERT (page->busy != busy);
+
+	page->busy = busy;
+	if (!busy)
+		cond_broadcast (&page_done, &vm_lock);
+}
+
+/* Waits until no other thread is reading PAGE in or writing it out,
+ * and takes PAGE off the prefetch queue: whoever asks for it will deal
+ * with it sooner.  Only PAGE's owner creates or destroys it, so it is
+ * still there. */
+static void
+page_wait (struct page *page) {
+	if (page->prefetch) {
+		list_remove (&page->prefetch_elem);
+		page->prefetch = false;
+	}
+	while (page->busy)
+		cond_wait (&page_done, &vm_lock);
+}
+
+/* Returns the frame table entry for the user page at KVA, or a null
+ * pointer if KVA is not in the user pool. */
+struct frame *
+vm_frame_lookup (void *kva) {
+	size_t idx = pg_no (kva) - pg_no (frame_base);
+
+	if ((uint8_t *) kva < frame_base || idx >= frame_cnt)
+		return NULL;
+	return &frame_table[idx];
+}
+
+/* Takes the frame table entry for KVA, a page just allocated from the
+ * user pool. */
+static struct frame *
+frame_table_get (void *kva) {
+	struct frame *frame = vm_frame_lookup (kva);
+
+	ASSERT (frame != NULL && frame->kva == NULL);
+
+	memset (frame, 0, sizeof *frame);
+	frame->kva = kva;
+	list_init (&frame->pages);
+	return frame;
+}
+
+/* Gives FRAME, which nothing maps any more, back to the user pool. */
+static void
+frame_table_put (struct frame *frame) {
+	ASSERT (frame->ref_cnt == 0 && frame->pin_cnt == 0);
+
+	palloc_free_page (frame->kva);
+	frame->kva = NULL;
+}
+
+/* Keeps FRAME, which is loaded and on the eviction queues, from being
+ * evicted until frame_unpin(). */
+static void
+frame_pin (struct frame *frame) {
+	if (frame->pin_cnt++ == 0)
+		evict_remove (frame);
+}
+
+static void
+frame_unpin (struct frame *frame) {
+	ASSERT (frame->pin_cnt > 0);
+
+	if (--frame->pin_cnt == 0 && frame->ref_cnt > 0)
+		evict_install (frame);
+}
+
+/* Returns whether FRAME was written since it was loaded or last asked,
+ * through any of its mappings, and clears the dirty bits for next
+ * time. */
+bool
+vm_frame_clear_dirty (struct frame *frame) {
+	bool dirty = frame->dirty;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4 != NULL && pml4_is_dirty (pml4, page->va)) {
+			pml4_set_dirty (pml4, page->va, false);
+			dirty = true;
+		}
+	}
+	frame->dirty = false;
+	return dirty;
+}
+
+/* Add PAGE to the pages mapping FRAME. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->ref_cnt++;
+	if (frame->page == NULL)
+		frame->page = page;
+	page->frame = frame;
+}
+
+/* Remove PAGE from the pages mapping FRAME. */
+static void
+frame_unlink (struct frame *frame, struct page *page) {
+	ASSERT (page->frame == frame);
+
+	/* Keep what the mapping saw in the summaries. */
+	if (page->owner->pml4 != NULL) {
+		if (pml4_is_dirty (page->owner->pml4, page->va))
+			frame->dirty = true;
+		if (pml4_is_accessed (page->owner->pml4, page->va))
+			frame->accessed = true;
+	}
+	list_remove (&page->frame_elem);
+	frame->ref_cnt--;
+	page->frame = NULL;
+	if (frame->ref_cnt == 0 && frame != &zero_frame)
+		ksm_forget (frame);
+	if (frame->page == page)
+		frame->page = frame->ref_cnt > 0 ?
+			list_entry (list_front (&frame->pages), struct page, frame_elem) :
+			NULL;
 }
 
 /* Get the struct frame, that will be evicted. */
 static struct frame *
 vm_get_victim (void) {
-	/* TODO: The policy for eviction is up to you. */
-	// if (!list_empty(&frame_list))
-	return list_entry (list_front (&frame_list), struct frame, f_elem);
+	/* The policy is chosen with -evict on the kernel command line. */
+	return evict_victim ();
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.
+ * Memory is tight whenever we get here, so up to SWAP_CLUSTER victims
+ * are taken at once: their anonymous pages go out to consecutive swap
+ * slots in a single transfer, and every frame but the one returned is
+ * given back to the user pool for the faults that follow.
+ * vm_lock is released during the writes.  The victims are off the
+ * eviction queues and out of the text cache, and their pages are busy,
+ * so nobody maps them again in the meantime. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim = vm_get_victim ();
+	struct frame *victims[SWAP_CLUSTER];
+	struct page *cluster[SWAP_CLUSTER];
+	size_t victim_cnt = 0, cluster_cnt = 0, i;
 
 	/* TODO: swap out the victim and return the evicted frame. */
-	if (!victim)
-		return NULL;
+	while (victim_cnt < SWAP_CLUSTER) {
+		struct frame *victim = vm_get_victim ();
 
-	if (!swap_out(victim->page))
+		if (victim == NULL)
+			break;
+		victims[victim_cnt++] = victim;
+	}
+	if (victim_cnt == 0)
 		return NULL;
+	for (i = 0; i < victim_cnt; i++) {
+		struct list_elem *e;
+
+		text_remove (victims[i]);
+		for (e = list_begin (&victims[i]->pages);
+				e != list_end (&victims[i]->pages); e = list_next (e))
+			vm_page_set_busy (list_entry (e, struct page, frame_elem), true);
+	}
+
+	/* A shared frame is swapped out once for every page mapping it. */
+	for (i = 0; i < victim_cnt; i++) {
+		struct list_elem *e;
 
-	list_remove (&victim->f_elem);
-	victim->page->frame = NULL;
-	victim->page = NULL;
+		for (e = list_begin (&victims[i]->pages);
+				e != list_end (&victims[i]->pages); e = list_next (e)) {
+			struct page *page = list_entry (e, struct page, frame_elem);
+
+			/* Other pages of the batch may be out already, so this
+			 * cannot be undone; like a full swap disk, it is fatal. */
+			if (VM_TYPE (page->operations->type) != VM_ANON) {
+				if (!swap_out (page))
+					PANIC ("vm_evict_frame : cannot write back page");
+				continue;
+			}
+			cluster[cluster_cnt++] = page;
+			if (cluster_cnt == SWAP_CLUSTER) {
+				anon_swap_out_cluster (cluster, cluster_cnt);
+				cluster_cnt = 0;
+			}
+		}
+	}
+	if (cluster_cnt > 0)
+		anon_swap_out_cluster (cluster, cluster_cnt);
 
-	return victim;
+	for (i = 0; i < victim_cnt; i++) {
+		struct frame *victim = victims[i];
+
+		while (victim->ref_cnt > 0) {
+			struct page *page = victim->page;
+
+			frame_unlink (victim, page);
+			vm_page_set_busy (page, false);
+		}
+		victim->dirty = victim->accessed = false;
+		if (i > 0)
+			frame_table_put (victim);
+	}
+	evict_cnt += victim_cnt;
+
+	return victims[0];
+}
+
+/* Returns a new frame from the user pool, or NULL if the pool is empty.
+ * If ZERO, the frame is filled with zeros; the idle thread keeps some
+ * frames zeroed ahead of time so that this is usually free. */
+static struct frame *
+vm_alloc_frame (bool zero) {
+	void *kva = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+
+	return kva != NULL ? frame_table_get (kva) : NULL;
+}
+
+/* Evicts a cluster of frames and gives them all back to the user pool.
+ * Called by the reclaim daemon.  Returns the number of frames freed. */
+size_t
+vm_reclaim (void) {
+	struct frame *frame;
+	long long before;
+
+	lock_acquire (&vm_lock);
+	before = evict_cnt;
+	frame = vm_evict_frame ();
+	if (frame != NULL)
+		frame_table_put (frame);
+	reclaim_cnt += evict_cnt - before;
+	lock_release (&vm_lock);
+	return evict_cnt - before;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space. If ZERO, the frame is filled with zeros.*/
 static struct frame *
-vm_get_frame (void) {
-	struct frame	*frame = NULL;
-	void			*kva = NULL;
+vm_get_frame (bool zero) {
+	struct frame	*frame;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
 
-	kva = palloc_get_page(PAL_USER);
-	if (kva == NULL) {
+	while ((frame = vm_alloc_frame (zero)) == NULL) {
 		frame = vm_evict_frame();
+		direct_cnt++;
+		if (frame != NULL) {
+			if (zero)
+				memset (frame->kva, 0, PGSIZE);
+			break;
+		}
+
+		/* Every frame is pinned or on its way out for another thread.
+		 * Wait for one of them to finish. */
+		cond_wait (&page_done, &vm_lock);
 	}
-	else {
-		frame = (struct frame *)calloc(sizeof(struct frame), 1);
-		if (frame == NULL)
-			PANIC("vm_get_frame : malloc fault");
-		frame->kva = kva;
+	reclaim_wake ();
+
+	ASSERT (frame->page == NULL);
+
+	return frame;
+}
+
+/* Moves every page mapping FROM over to INTO, which holds the same
+ * bytes, read-only, and frees FROM.  A write to one of the pages gets
+ * it a copy of its own again in vm_handle_wp(). */
+void
+vm_frame_merge (struct frame *from, struct frame *into) {
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+	ASSERT (from != into && from->pin_cnt == 0);
+
+	while (!list_empty (&from->pages)) {
+		struct page *page = list_entry (list_front (&from->pages),
+				struct page, frame_elem);
+
+		pml4_clear_page (page->owner->pml4, page->va);
+		frame_unlink (from, page);
+		frame_link (into, page);
+		/* The page table is there already. */
+		if (!pml4_set_page (page->owner->pml4, page->va, into->kva, false))
+			PANIC ("vm_frame_merge : out of memory");
 	}
+	evict_remove (from);
+	frame_table_put (from);
+}
 
-	list_push_back (&frame_list, &frame->f_elem);
+/* Lets ksm_scan() look at the next CNT frames of the frame table,
+ * starting over at the end.  Called by the merging thread. */
+void
+vm_ksm_scan (size_t cnt) {
+	lock_acquire (&vm_lock);
+	while (cnt-- > 0) {
+		if (ksm_next == frame_cnt) {
+			ksm_pass_done ();
+			ksm_next = 0;
+		}
+		ksm_scan (&frame_table[ksm_next++]);
+	}
+	lock_release (&vm_lock);
+}
 
-	frame->page = NULL;
+/* Gives PAGE a free frame, without evicting anything, for a page that
+ * is about to be read in ahead of its fault.  The frame is neither
+ * mapped nor on the eviction queues: the owner still faults on PAGE,
+ * and waits, until the caller has filled it and called
+ * vm_install_spare_frame(), or given it up with
+ * vm_release_spare_frame().  Returns NULL if there is no free frame. */
+struct frame *
+vm_claim_spare_frame (struct page *page) {
+	struct frame *frame;
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	ASSERT (lock_held_by_current_thread (&vm_lock));
 
+	frame = vm_alloc_frame (false);
+	if (frame == NULL)
+		return NULL;
+	frame_link (frame, page);
 	return frame;
 }
 
+/* Maps PAGE, whose frame from vm_claim_spare_frame() now holds its
+ * contents, and lets the frame be evicted.  If there is no memory for
+ * the page table, PAGE stays resident unmapped, and is mapped when its
+ * owner faults on it. */
+void
+vm_install_spare_frame (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	pml4_set_page (page->owner->pml4, page->va, page->frame->kva,
+			page_map_rw (page));
+	evict_install (page->frame);
+}
+
+/* Gives back PAGE's frame from vm_claim_spare_frame(), which could not
+ * be filled. */
+void
+vm_release_spare_frame (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	frame_unlink (frame, page);
+	frame_table_put (frame);
+}
+
 /* Growing the stack. */
-static void
+static bool
 vm_stack_growth (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *stack = vma_find (spt, (void *) (USER_STACK - PGSIZE));
+	struct page *page;
+
+	/* Only the faulting page is claimed.  The pages between it and the
+	 * old stack fault in later, most likely as zero pages. */
 	addr = pg_round_down(addr);
-	while ((spt_find_page(&thread_current()->spt, addr)) == NULL) {
-		vm_alloc_page(VM_ANON | VM_MARKER_0, addr, 1);
-		vm_claim_page(addr);
-		addr += PGSIZE;
+	if (stack == NULL || !vma_grow_down (spt, stack, addr))
+		return false;
+	page = spt_find_page (spt, addr);
+	return page != NULL && vm_do_claim_page (page);
+}
+
+/* Handle the fault on write_protected page.
+ * PAGE is writable but shares its frame copy-on-write: give it a private
+ * copy, or just the write permission if no one else maps the frame. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct frame *old = page->frame;
+	struct frame *new;
+
+	if (!page->writable || old == NULL)
+		return false;
+
+	/* ELF data is an ordinary anonymous page from its first write on. */
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		page->anon.clean = false;
+
+	if (old->ref_cnt == 1 && old != &zero_frame) {
+		/* Its contents are about to change. */
+		ksm_forget (old);
+		pml4_set_writable (page->owner->pml4, page->va, true);
+		return true;
+	}
+
+	if (old == &zero_frame) {
+		new = vm_get_frame (true);
+		frame_unlink (old, page);
+		zero_copy_cnt++;
+	} else {
+		/* Keep OLD from being evicted while we copy out of it. */
+		frame_pin (old);
+		new = vm_get_frame (false);
+		memcpy (new->kva, old->kva, PGSIZE);
+		frame_unlink (old, page);
+		frame_unpin (old);
+
+		/* The other sharers may have gone while vm_get_frame() had
+		 * vm_lock released. */
+		if (old->ref_cnt == 0 && old->pin_cnt == 0) {
+			evict_remove (old);
+			text_remove (old);
+			frame_table_put (old);
+		}
+	}
+
+	frame_link (new, page);
+	pml4_clear_page (page->owner->pml4, page->va);
+	if (!pml4_set_page (page->owner->pml4, page->va, new->kva, true)) {
+		frame_unlink (new, page);
+		frame_table_put (new);
+		return false;
+	}
+	evict_install (new);
+	return true;
+}
+
+/* Returns whether PAGE is mapped writable as it is loaded.  ELF data
+ * is mapped read-only until its first write, so that it is still known
+ * to match the executable when it is evicted. */
+static bool
+page_map_rw (struct page *page) {
+	return page->writable && !exec_page_clean (page);
+}
+
+/* Returns whether PAGE has never been loaded and would load as all
+ * zeros: an anonymous page without initializer, or a page of BSS. */
+static bool
+page_is_zero_fill (struct page *page) {
+	struct file_info *fi = page->uninit.aux;
+
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON)
+		return false;
+	if (page->uninit.init == NULL)
+		return true;
+	return page->uninit.init == lazy_load_segment && fi != NULL
+		&& fi->page_read_bytes == 0;
+}
+
+/* Maps PAGE, which would load as zeros, read-only to zero_frame.  Its
+ * first write gives it a frame of its own, in vm_handle_wp(). */
+static bool
+vm_map_zero (struct page *page) {
+	if (!page->uninit.page_initializer (page, page->uninit.type,
+				zero_frame.kva))
+		return false;
+	frame_link (&zero_frame, page);
+	if (!pml4_set_page (page->owner->pml4, page->va, zero_frame.kva, false)) {
+		frame_unlink (&zero_frame, page);
+		return false;
+	}
+	zero_map_cnt++;
+	return true;
+}
+
+/* Maps PAGE, a read-only page of program text, to the frame that holds
+ * it for another process.  Returns false if no frame does. */
+static bool
+vm_share_text (struct page *page) {
+	struct frame *frame = text_find (page);
+
+	if (frame == NULL)
+		return false;
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& !page->uninit.page_initializer (page, page->uninit.type,
+				frame->kva))
+		return false;
+	frame_link (frame, page);
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva, false)) {
+		frame_unlink (frame, page);
+		return false;
+	}
+	return true;
+}
+
+/* Returns whether the HPAGE_SIZE bytes at BASE lie in one writable
+ * anonymous region of SPT, would all load as zeros, and have not been
+ * touched yet. */
+static bool
+huge_fits (struct supplemental_page_table *spt, void *base) {
+	struct vma *vma = vma_find (spt, base);
+	size_t i;
+
+	if (vma == NULL || base + HPAGE_SIZE > vma->end || !vma->writable
+			|| VM_TYPE (vma->type) != VM_ANON
+			|| (vma->file != NULL
+				&& (size_t) (base - vma->start) < vma->read_bytes))
+		return false;
+	for (i = 0; i < HPAGE_CNT; i++)
+		if (spt_lookup_page (spt, base + i * PGSIZE) != NULL)
+			return false;
+	return true;
+}
+
+/* Tries to map the huge page around ADDR with a single page directory
+ * entry.  Each of its pages still gets a struct page and a struct
+ * frame of its own, so eviction, fork and munmap handle them one at a
+ * time; the MMU splits the huge page when that happens.  Returns false
+ * if the huge page does not fit there or no aligned run of free frames
+ * is left. */
+static bool
+vm_map_huge (struct supplemental_page_table *spt, void *addr) {
+	void *base = (void *) ((uint64_t) addr & ~(HPAGE_SIZE - 1));
+	struct vma *vma = vma_find (spt, base);
+	uint8_t *kva;
+	size_t i;
+
+	if (!huge_fits (spt, base))
+		return false;
+	kva = palloc_get_aligned (PAL_USER | PAL_ZERO, HPAGE_CNT, HPAGE_CNT);
+	if (kva == NULL)
+		return false;
+
+	for (i = 0; i < HPAGE_CNT; i++) {
+		struct page *page = spt_create_page (spt, vma, base + i * PGSIZE);
+		struct frame *frame;
+
+		if (page == NULL)
+			goto fail;
+		frame = frame_table_get (kva + i * PGSIZE);
+		frame_link (frame, page);
+		if (!page->uninit.page_initializer (page, page->uninit.type,
+					frame->kva)) {
+			frame_unlink (frame, page);
+			frame->kva = NULL;
+			goto fail;
+		}
+		/* Mapped writable, so BSS has to go to swap like the rest. */
+		page->anon.clean = false;
+	}
+	if (!pml4_set_huge_page (thread_current ()->pml4, base, kva, true))
+		goto fail;
+
+	for (i = 0; i < HPAGE_CNT; i++)
+		evict_install (spt_lookup_page (spt, base + i * PGSIZE)->frame);
+	huge_cnt++;
+	return true;
+
+fail:
+	/* Pages that got a frame give it back when they are destroyed. */
+	for (i = 0; i < HPAGE_CNT; i++) {
+		struct page *page = spt_lookup_page (spt, base + i * PGSIZE);
+
+		if (page == NULL || page->frame == NULL)
+			palloc_free_page (kva + i * PGSIZE);
+		if (page != NULL) {
+			hash_delete (&spt->h, &page->hash_elem);
+			vm_dealloc_page (page);
+		}
+	}
+	return false;
+}
+
+/* Returns the file_info describing where PAGE's contents come from, if
+ * they still have to be read from a file, or NULL. */
+static struct file_info *
+page_pending_file (struct page *page) {
+	if (page->frame != NULL)
+		return NULL;
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			return page->uninit.init == lazy_load_segment ?
+				page->uninit.aux : NULL;
+		case VM_ANON:
+			/* Program text or clean data that eviction dropped. */
+			return exec_page_clean (page)
+				&& page->anon.swap_slot == (disk_sector_t) -1 ?
+				page->anon.aux : NULL;
+		case VM_FILE:
+			return page->file.aux;
+		default:
+			return NULL;
 	}
 }
 
-/* Handle the fault on write_protected page */
+/* Returns the run that a fault on VA belongs to.  A fault where a run
+ * left off continues it and may widen its window; any other fault
+ * starts a new run. */
+static struct fault_stream *
+fault_stream_find (struct supplemental_page_table *spt, void *va) {
+	struct fault_stream *s;
+	int i;
+
+	for (i = 0; i < FAULT_STREAM_CNT; i++) {
+		s = &spt->streams[i];
+		if (s->next == va) {
+			if (++s->seq < FAULT_AROUND_SEQ)
+				s->window = 1;
+			else if (s->window < FAULT_AROUND_MIN)
+				s->window = FAULT_AROUND_MIN;
+			else if (s->window * 2 < FAULT_AROUND_MAX)
+				s->window *= 2;
+			else
+				s->window = FAULT_AROUND_MAX;
+			return s;
+		}
+	}
+	s = &spt->streams[spt->stream_next++ % FAULT_STREAM_CNT];
+	s->seq = 0;
+	s->window = 1;
+	return s;
+}
+
+/* Loads PAGE, which nobody has faulted on yet, into a free frame.
+ * Nothing is evicted to make room.  Returns false if there is no free
+ * frame or PAGE cannot be read. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_load_ahead (struct page *page) {
+	struct frame *frame;
+
+	if (page_is_zero_fill (page) ? vm_map_zero (page) : vm_share_text (page))
+		return true;
+	frame = vm_claim_spare_frame (page);
+	if (frame == NULL)
+		return false;
+	vm_page_set_busy (page, true);
+	if (!swap_in (page, frame->kva)) {
+		vm_release_spare_frame (page);
+		vm_page_set_busy (page, false);
+		return false;
+	}
+	vm_install_spare_frame (page);
+	vm_page_set_busy (page, false);
+	text_insert (page, frame);
+	return true;
+}
+
+/* PAGE, which was read from FI, has just been claimed.  Also load the
+ * pages that follow it in the same file, up to the window of its run,
+ * so that a sequential scan takes one fault per window instead of one
+ * per page.  Only free frames are used.  A region advised MADV_RANDOM
+ * gets no fault-around, one advised MADV_SEQUENTIAL the widest window
+ * from its first fault. */
+static void
+vm_fault_around (struct supplemental_page_table *spt, struct page *page,
+		struct file *file, off_t ofs) {
+	int advice = vma_advice (page);
+	struct fault_stream *s;
+	size_t i;
+
+	if (advice == MADV_RANDOM)
+		return;
+	s = fault_stream_find (spt, page->va);
+	if (advice == MADV_SEQUENTIAL)
+		s->window = FAULT_AROUND_MAX;
+
+	for (i = 1; i < s->window; i++) {
+		struct page *next = spt_find_page (spt, page->va + i * PGSIZE);
+		struct file_info *fi;
+
+		if (next == NULL || (fi = page_pending_file (next)) == NULL
+				|| fi->file != file || fi->ofs != ofs)
+			break;
+		ofs += fi->page_read_bytes;
+		if (!vm_load_ahead (next))
+			break;
+		around_cnt++;
+	}
+	s->next = page->va + i * PGSIZE;
+}
+
+/* PAGE, in a region advised MADV_SEQUENTIAL, has just been faulted in.
+ * A scan will not come back to the pages well behind it, so make those
+ * the first to be evicted, before anything that may be used again. */
+static void
+vm_drop_behind (struct supplemental_page_table *spt, struct page *page) {
+	struct vma *vma = vma_find (spt, page->va);
+	size_t i;
+
+	if (vma == NULL || vma->advice != MADV_SEQUENTIAL)
+		return;
+	for (i = FAULT_AROUND_MAX; i < 2 * FAULT_AROUND_MAX; i++) {
+		struct page *behind;
+
+		if ((size_t) (page->va - vma->start) < i * PGSIZE)
+			break;
+		behind = spt_lookup_page (spt, page->va - i * PGSIZE);
+		if (behind != NULL && behind->frame != NULL
+				&& behind->frame->ref_cnt == 1) {
+			evict_deactivate (behind->frame);
+			behind_cnt++;
+		}
+	}
+}
+
+/* Reads in the pages queued by MADV_WILLNEED, so that their owners find
+ * them resident.  Only free frames are used; once they run out, the
+ * rest of the queue is dropped. */
+static void
+prefetch_daemon (void *aux UNUSED) {
+	lock_acquire (&vm_lock);
+	for (;;) {
+		struct page *page;
+
+		while (list_empty (&prefetch_queue))
+			cond_wait (&prefetch_ready, &vm_lock);
+		page = list_entry (list_pop_front (&prefetch_queue), struct page,
+				prefetch_elem);
+		page->prefetch = false;
+		if (page->frame != NULL)
+			continue;
+		if (vm_load_ahead (page)) {
+			prefetch_cnt++;
+			continue;
+		}
+		while (!list_empty (&prefetch_queue)) {
+			page = list_entry (list_pop_front (&prefetch_queue), struct page,
+					prefetch_elem);
+			page->prefetch = false;
+		}
+	}
 }
 
 /* Return true on success */
 bool
 vm_try_handle_fault (struct intr_frame *f, void *addr,
 		bool user, bool write, bool not_present) {
+	long long before;
+	bool success;
+
+	lock_acquire (&vm_lock);
+	fault_cnt++;
+	before = direct_cnt;
+	success = vm_handle_fault (f, addr, user, write, not_present);
+	if (direct_cnt == before)
+		nowait_cnt++;
+	lock_release (&vm_lock);
+	return success;
+}
+
+/* Handles a page fault with vm_lock held. */
+static bool
+vm_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
 	// if (pg_round_down (addr) == 0x4747f000)
 	// 	printf("handle user %d/ write %d /present %d\n", user, write, not_present);
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
+	struct file_info *fi;
 	/* TODO: Validate the fault */
 	/* TODO: Your code goes here */
 
 	if (not_present) {
+		if (vm_huge_pages && vm_map_huge (spt, addr))
+			return true;
+
 		// printf("addr : %p, cmp1 : %p, cmp2 : %p\n", (uint64_t)addr, USER_STACK - STACK_MAX_SIZE, f->rsp - 8);
 		page = spt_find_page(spt, pg_round_down (addr));
 		if (page == NULL) {
 			if ((uint64_t)addr > USER_STACK - STACK_MAX_SIZE && \
 				(uint64_t)addr & VM_MARKER_0 && \
 				(uint64_t)addr ==  f->rsp - 8) {
-				vm_stack_growth(addr);
-				return true;
+				return vm_stack_growth(addr);
 			}
 			else 
 				return false;
 		}
+	} else
+		page = spt_find_page(spt, pg_round_down (addr));
+
+	if (page == NULL)
+		return false;
+
+	/* The page may be on its way to or from disk for another thread, and
+	 * may be resident or not by the time it is done, whatever the fault
+	 * said. */
+	page_wait (page);
 
-		return vm_claim_page (addr);
+	if (page->frame == NULL) {
+		if (!write && page_is_zero_fill (page))
+			return vm_map_zero (page);
+
+		fi = page_pending_file (page);
+		if (fi != NULL) {
+			struct file *file = fi->file;
+			off_t ofs = fi->ofs + fi->page_read_bytes;
+
+			if (!vm_do_claim_page (page))
+				return false;
+			vm_fault_around (spt, page, file, ofs);
+		} else if (!vm_do_claim_page (page))
+			return false;
+		vm_drop_behind (spt, page);
+		/* ELF data came in read-only. */
+		if (write && page->writable && exec_page_clean (page))
+			return vm_handle_wp (page);
+		return true;
 	}
-	return false;
+
+	/* Read in ahead of its fault, but left unmapped for lack of memory
+	 * for the page table. */
+	if (not_present && pml4_get_page (page->owner->pml4, page->va) == NULL
+			&& !pml4_set_page (page->owner->pml4, page->va, page->frame->kva,
+				page_map_rw (page) && page->frame->ref_cnt == 1))
+		return false;
+
+	if (write)
+		return vm_handle_wp (page);
+
+	/* Mapped by read-ahead while we waited. */
+	return not_present;
 }
 
 /* Free the page.
@@ -223,26 +1278,81 @@ vm_dealloc_page (struct page *page) {
 bool
 vm_claim_page (void *va) {
 	struct page *page = spt_find_page(&thread_current()->spt, va);
+	bool success;
+
 	if (page == NULL)
 		return false;
-	return vm_do_claim_page (page);
+	lock_acquire (&vm_lock);
+	success = vm_do_claim_page (page);
+	lock_release (&vm_lock);
+	return success;
 }
 
-/* Claim the PAGE and set up the mmu. */
+/* Claim the PAGE and set up the mmu.
+ * PAGE may belong to another process; it is mapped in its owner's pml4. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame	*frame = vm_get_frame ();
-	struct thread	*cur = thread_current();
+	struct frame	*frame;
+
+	if (vm_share_text (page))
+		return true;
+
+	/* Eviction and the read below may both let other threads run. */
+	vm_page_set_busy (page, true);
+	/* A page with nothing to load in must start out zeroed. */
+	frame = vm_get_frame (page_is_zero_fill (page)
+			&& page->uninit.init == NULL);
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	frame_link (frame, page);
+
+	/* Map the page only once it is loaded, as for read-ahead.  A page
+	 * that cannot be read in gives its frame back right away; the
+	 * caller need not be a fault that kills the process. */
+	if (!swap_in (page, frame->kva)) {
+		frame_unlink (frame, page);
+		frame_table_put (frame);
+		vm_page_set_busy (page, false);
+		return false;
+	}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	if (!pml4_set_page(cur->pml4, page->va, frame->kva, page->writable))
+	/* Only a fully loaded page is mapped or chosen as a victim.
+	 * Without memory for the page table it stays resident unmapped,
+	 * and its next fault tries again. */
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page_map_rw (page))) {
+		evict_install (frame);
+		vm_page_set_busy (page, false);
 		return false;
+	}
+	evict_install (frame);
+	vm_page_set_busy (page, false);
+	text_insert (page, frame);
+	return true;
+}
+
+/* Unmap PAGE and drop its reference to its frame, if it has one.  The
+ * last reference gives the frame back to the user pool. */
+void
+vm_free_frame (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
 
-	return swap_in (page, frame->kva);
+	if (frame == NULL)
+		return;
+
+	/* A dying address space is never entered again; its mappings go
+	 * with its page tables, see pml4_destroy(). */
+	if (page->owner->pml4 != NULL && !page->owner->spt.dying)
+		pml4_clear_page (page->owner->pml4, page->va);
+	frame_unlink (frame, page);
+	if (frame->ref_cnt > 0 || frame == &zero_frame)
+		return;
+
+	evict_remove (frame);
+	text_remove (frame);
+	frame_table_put (frame);
 }
 
 static uint64_t spt_hash_func(const struct hash_elem *e, void *aux) {
@@ -263,6 +1373,11 @@ static bool spt_hash_less_func(const struct hash_elem *a,
 void
 supplemental_page_table_init (struct supplemental_page_table *spt) {
 	hash_init (&spt->h, spt_hash_func, spt_hash_less_func, NULL);
+	vma_init (spt);
+	memset (spt->streams, 0, sizeof spt->streams);
+	spt->stream_next = 0;
+	spt->dying = false;
+	spt->dead_slot_cnt = 0;
 }
 
 static bool
@@ -293,6 +1408,8 @@ page_copy_action(struct supplemental_page_table *spt, struct page *src) {
 	void *upage = src->va;
 	struct page *dst;
 
+	page_wait (src);
+
 	switch (VM_TYPE(src->operations->type)) {
 		case VM_UNINIT:
 			src_aux = src->uninit.aux;
@@ -320,8 +1437,22 @@ page_copy_action(struct supplemental_page_table *spt, struct page *src) {
 		return false;
 
 	if (VM_TYPE(src->operations->type) != VM_UNINIT) {
-		if (vm_do_claim_page(dst))
-			memcpy(dst->frame->kva, src->frame->kva, PGSIZE);
+		/* A swapped-out page has to come back before it can be shared. */
+		if (src->frame == NULL && !vm_do_claim_page (src))
+			return false;
+
+		/* Transmute DST as its first fault would, but share SRC's frame
+		 * read-only instead of loading the contents again.  The first
+		 * write from either side ends up in vm_handle_wp(). */
+		if (!dst->uninit.page_initializer (dst, dst->uninit.type,
+					src->frame->kva))
+			return false;
+		if (VM_TYPE (src->operations->type) == VM_ANON)
+			dst->anon.clean = src->anon.clean;
+		frame_link (src->frame, dst);
+		if (!pml4_set_page (dst->owner->pml4, upage, src->frame->kva, false))
+			return false;
+		pml4_set_writable (src->owner->pml4, upage, false);
 	}
 
 	return true;
@@ -333,28 +1464,85 @@ supplemental_page_table_copy (struct supplemental_page_table *dst,
 	// printf("########################  %s  ########################\n", "supplemental_page_table_copy");
 	struct hash *src_hash = &src->h;
 	struct hash_iterator src_iter;
+	bool success = true;
 
+	if (!vma_copy (dst, src))
+		return false;
+
+	lock_acquire (&vm_lock);
 	hash_first(&src_iter, src_hash);
 	while (hash_next (&src_iter)) {
 		struct page *src_page = hash_entry (hash_cur (&src_iter), struct page, hash_elem);
 		if(!page_copy_action(dst, src_page)) {
-			return false;
+			success = false;
+			break;
 		}
 	}
-	return true;
+	lock_release (&vm_lock);
+	return success;
 }
 
 
 static void
 hash_destroy_action(struct hash_elem *e, void *aux) {
 	struct page *page = hash_entry(e, struct page, hash_elem);
+	page_wait (page);
 	vm_dealloc_page(page);
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Free the resource hold by the supplemental page table.
+ * The whole address space goes at once: dirty file pages are written
+ * back a run at a time, pages are destroyed region by region without
+ * unmapping each one, and swap slots go back in runs.  The caller then
+ * frees the page tables with pml4_destroy(). */
 void
 supplemental_page_table_kill (struct supplemental_page_table *spt) {
-	hash_clear(&spt->h, hash_destroy_action);
+	size_t i;
+
+	lock_acquire (&vm_lock);
+	for (i = 0; i < spt->vma_cnt; i++)
+		if (VM_TYPE (spt->vmas[i]->type) == VM_FILE)
+			spt_writeback (spt, spt->vmas[i]->start, spt->vmas[i]->end);
+
+	spt->dying = true;
+	teardown_cnt += hash_size (&spt->h);
+	for (i = 0; i < spt->vma_cnt; i++)
+		spt_destroy_range (spt, spt->vmas[i]->start, spt->vmas[i]->end);
+	/* Pages outside of any region, if there are still some. */
+	hash_clear (&spt->h, hash_destroy_action);
+	anon_free_dead_slots (spt);
+	spt->dying = false;
+	lock_release (&vm_lock);
+	vma_kill (spt);
+}
+
+/* Print statistics about page faults and eviction. */
+void
+vm_print_stats (void) {
+	printf ("Eviction: %s policy, %lld page faults, %lld evictions, "
+			"%lld ghost hits\n", evict_policy_name (), fault_cnt, evict_cnt,
+			evict_ghost_hits ());
+	printf ("Fault-around: %lld pages loaded ahead of their fault\n",
+			around_cnt);
+	printf ("Text: %lld pages shared instead of read\n", text_hits ());
+	printf ("Regions: %lld pages created on first touch\n", region_page_cnt);
+	printf ("Huge pages: %lld mapped, %lld split\n", huge_cnt,
+			pml4_huge_splits ());
+	printf ("Zero page: %lld pages mapped, %lld written later, "
+			"%lld frames saved\n", zero_map_cnt, zero_copy_cnt,
+			zero_map_cnt - zero_copy_cnt);
+	printf ("Advice: %lld pages prefetched, %lld populated, %lld discarded, "
+			"%lld dropped behind\n", prefetch_cnt, populate_cnt, discard_cnt,
+			behind_cnt);
+	printf ("Teardown: %lld pages freed at exit without unmapping\n",
+			teardown_cnt);
+	printf ("Reclaim: %lld of %lld faults served without direct reclaim, "
+			"%lld frames reclaimed in background, watermarks %zu/%zu\n",
+			nowait_cnt, fault_cnt, reclaim_cnt, reclaim_low_wm,
+			reclaim_high_wm);
+	ksm_print_stats ();
+	vm_anon_print_stats ();
+	vm_file_print_stats ();
 }
 
 void print_spt(void) {
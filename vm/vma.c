@@ -0,0 +1,176 @@
+/* vma.c: Regions of a process's address space.
+ *
+ * Each supplemental page table keeps its regions in an array sorted by
+ * start address, so a lookup is a binary search.  Processes have a
+ * handful of regions, one per ELF segment and mapping plus the stack,
+ * so the array is cheap to keep sorted by shifting on insert. */
+
+#include "vm/vma.h"
+#include <string.h>
+#include <syscall-nr.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+/* Returns the index of the first region in SPT that ends after VA,
+ * which is the region holding VA if there is one. */
+static size_t
+vma_index (struct supplemental_page_table *spt, const void *va) {
+	size_t lo = 0, hi = spt->vma_cnt;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (spt->vmas[mid]->end <= va)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void
+vma_init (struct supplemental_page_table *spt) {
+	spt->vmas = NULL;
+	spt->vma_cnt = 0;
+	spt->vma_cap = 0;
+}
+
+/* Inserts VMA into SPT, keeping the array sorted.  Returns false if it
+ * overlaps another region or memory is short. */
+static bool
+vma_insert (struct supplemental_page_table *spt, struct vma *vma) {
+	size_t i = vma_index (spt, vma->start);
+
+	if (i < spt->vma_cnt && spt->vmas[i]->start < vma->end)
+		return false;
+
+	if (spt->vma_cnt == spt->vma_cap) {
+		size_t cap = spt->vma_cap ? spt->vma_cap * 2 : 8;
+		struct vma **vmas = realloc (spt->vmas, cap * sizeof *vmas);
+
+		if (vmas == NULL)
+			return false;
+		spt->vmas = vmas;
+		spt->vma_cap = cap;
+	}
+	memmove (&spt->vmas[i + 1], &spt->vmas[i],
+			(spt->vma_cnt - i) * sizeof *spt->vmas);
+	spt->vmas[i] = vma;
+	spt->vma_cnt++;
+	return true;
+}
+
+/* Adds a region of PAGE_CNT pages at START to SPT.  Its pages have type
+ * TYPE and are loaded by INIT; the first READ_BYTES bytes come from FILE
+ * at OFS, the rest are zeros.  Returns the new region, or NULL if it
+ * would overlap another one or memory is short. */
+struct vma *
+vma_add (struct supplemental_page_table *spt, void *start, size_t page_cnt,
+		enum vm_type type, bool writable, vm_initializer *init,
+		struct file *file, off_t ofs, size_t read_bytes) {
+	struct vma *vma;
+
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT (page_cnt > 0);
+
+	vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return NULL;
+	vma->start = start;
+	vma->end = start + page_cnt * PGSIZE;
+	vma->type = type;
+	vma->writable = writable;
+	vma->init = init;
+	vma->file = file;
+	vma->ofs = ofs;
+	vma->read_bytes = read_bytes;
+	vma->advice = MADV_NORMAL;
+
+	if (vma->end <= start || !is_user_vaddr (vma->end - 1)
+			|| !vma_insert (spt, vma)) {
+		free (vma);
+		return NULL;
+	}
+	return vma;
+}
+
+/* Returns the region of SPT that contains VA, or NULL. */
+struct vma *
+vma_find (struct supplemental_page_table *spt, const void *va) {
+	size_t i = vma_index (spt, va);
+
+	if (i < spt->vma_cnt && spt->vmas[i]->start <= va)
+		return spt->vmas[i];
+	return NULL;
+}
+
+/* Returns how PAGE's owner said the region holding PAGE will be used,
+ * as set with madvise(). */
+int
+vma_advice (struct page *page) {
+	struct vma *vma = vma_find (&page->owner->spt, page->va);
+
+	return vma != NULL ? vma->advice : MADV_NORMAL;
+}
+
+/* Extends VMA, a region without file contents, down to START.  Returns
+ * false if that would run into the region below it. */
+bool
+vma_grow_down (struct supplemental_page_table *spt, struct vma *vma,
+		void *start) {
+	size_t i = vma_index (spt, vma->start);
+
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT (vma->file == NULL);
+
+	if (start >= vma->start)
+		return true;
+	if (i > 0 && spt->vmas[i - 1]->end > start)
+		return false;
+	vma->start = start;
+	return true;
+}
+
+/* Removes VMA from SPT and frees it.  Its pages must be gone already. */
+void
+vma_remove (struct supplemental_page_table *spt, struct vma *vma) {
+	size_t i = vma_index (spt, vma->start);
+
+	ASSERT (i < spt->vma_cnt && spt->vmas[i] == vma);
+
+	memmove (&spt->vmas[i], &spt->vmas[i + 1],
+			(spt->vma_cnt - i - 1) * sizeof *spt->vmas);
+	spt->vma_cnt--;
+	free (vma);
+}
+
+/* Gives DST, which has no regions, a copy of every region of SRC. */
+bool
+vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	size_t i;
+
+	for (i = 0; i < src->vma_cnt; i++) {
+		struct vma *vma = malloc (sizeof *vma);
+
+		if (vma == NULL)
+			return false;
+		*vma = *src->vmas[i];
+		if (!vma_insert (dst, vma)) {
+			free (vma);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Frees every region of SPT. */
+void
+vma_kill (struct supplemental_page_table *spt) {
+	size_t i;
+
+	for (i = 0; i < spt->vma_cnt; i++)
+		free (spt->vmas[i]);
+	free (spt->vmas);
+	vma_init (spt);
+}
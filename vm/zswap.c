@@ -0,0 +1,288 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+ *
+ * An anonymous page being swapped out is first compressed, and if it
+ * fits in a malloc() block, a quarter of a page or less, it is kept in
+ * kernel memory instead of being written to disk.  Swapping it back in
+ * is a decompression.  Pages that do not compress that well, or that
+ * do not fit under zswap_limit, go to disk as before.
+ *
+ * The compressor is a small LZ77 in the LZ4 style.  A page becomes a
+ * series of sequences, each a token byte, literal bytes, and a match
+ * given by a 2-byte offset back into the output:
+ *
+ *   token    high nibble: literal count, low nibble: match length - 4.
+ *            A nibble of 15 is followed by bytes of 255 and a final
+ *            byte less than 255, which are all added to it.
+ *   literals copied as they are.
+ *   offset   how far back the match starts, little-endian.
+ *
+ * The last sequence has literals only and ends the input.  Matches
+ * are found through a hash of the next 4 bytes, which makes the
+ * compressor fast and lets it get most of what a page of zeros, text
+ * or small integers has to offer. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+#define MIN_MATCH 4
+#define HASH_BITS 10
+
+/* A compressed page. */
+struct zswap_entry {
+	size_t len;                 /* Bytes in DATA. */
+	uint8_t data[];
+};
+
+/* The largest block malloc() hands out; anything larger takes whole
+ * pages of the kernel pool.  See malloc_init(). */
+#define MALLOC_BLOCK_MAX 1024
+
+/* Pages that compress to more than this go to disk. */
+#define ZSWAP_MAX (MALLOC_BLOCK_MAX - sizeof (struct zswap_entry))
+
+size_t zswap_limit = SIZE_MAX;
+
+/* Compressor state and statistics, under zswap_lock. */
+static struct lock zswap_lock;
+static uint16_t hash_table[1 << HASH_BITS];
+static uint8_t zbuf[ZSWAP_MAX];
+static size_t used_bytes;           /* Bytes of malloc() blocks held. */
+static size_t peak_bytes;           /* Most ever held at once. */
+
+static long long store_cnt;         /* # of pages stored. */
+static long long stored_bytes;      /* Their total block size. */
+static long long reject_cnt;        /* # that compressed badly. */
+static long long full_cnt;          /* # turned away for lack of room. */
+static long long load_cnt;          /* # of swap-ins served here. */
+
+/* Sets the default limit, 1/8 of the size of the user pool. */
+void
+zswap_init (void) {
+	lock_init (&zswap_lock);
+	if (zswap_limit == SIZE_MAX)
+		zswap_limit = palloc_user_free_cnt () / 8;
+}
+
+/* Returns the size of the malloc() block that holds an entry of LEN
+ * compressed bytes. */
+static size_t
+entry_size (size_t len) {
+	size_t size = 16;
+
+	while (size < sizeof (struct zswap_entry) + len)
+		size *= 2;
+	ASSERT (size <= MALLOC_BLOCK_MAX);
+	return size;
+}
+
+static uint32_t
+read32 (const uint8_t *p) {
+	uint32_t v;
+
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Appends LEN, less than the 15 of its nibble, as 255s and a rest. */
+static uint8_t *
+put_len (uint8_t *op, size_t len) {
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/* Appends a sequence of LIT_LEN literals at LIT followed by a match of
+ * MATCH_LEN bytes OFS back, or no match if MATCH_LEN is 0.  Returns
+ * false if it would not fit before OEND. */
+static bool
+put_sequence (uint8_t **opp, uint8_t *oend, const uint8_t *lit,
+		size_t lit_len, size_t ofs, size_t match_len) {
+	uint8_t *op = *opp;
+	uint8_t *token;
+	size_t need = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+
+	if ((size_t) (oend - op) < need)
+		return false;
+
+	token = op++;
+	*token = (lit_len < 15 ? lit_len : 15) << 4;
+	if (lit_len >= 15)
+		op = put_len (op, lit_len - 15);
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+
+	if (match_len > 0) {
+		match_len -= MIN_MATCH;
+		*token |= match_len < 15 ? match_len : 15;
+		*op++ = ofs & 0xff;
+		*op++ = ofs >> 8;
+		if (match_len >= 15)
+			op = put_len (op, match_len - 15);
+	}
+	*opp = op;
+	return true;
+}
+
+/* Compresses the page at SRC into DST, which has room for DST_MAX
+ * bytes.  Returns the compressed size, or 0 if it does not fit. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t dst_max) {
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *end = src + PGSIZE;
+	uint8_t *op = dst, *oend = dst + dst_max;
+
+	memset (hash_table, 0, sizeof hash_table);
+	while (ip + MIN_MATCH <= end) {
+		uint32_t seq = read32 (ip);
+		size_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+		const uint8_t *ref = src + hash_table[h];
+		size_t len;
+
+		hash_table[h] = ip - src;
+		if (ref >= ip || read32 (ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		for (len = MIN_MATCH; ip + len < end && ref[len] == ip[len]; len++)
+			continue;
+		if (!put_sequence (&op, oend, anchor, ip - anchor, ip - ref, len))
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (!put_sequence (&op, oend, anchor, end - anchor, 0, 0))
+		return 0;
+	return op - dst;
+}
+
+/* Reads a length continued past its nibble. */
+static bool
+get_len (const uint8_t **ipp, const uint8_t *iend, size_t *len) {
+	const uint8_t *ip = *ipp;
+	uint8_t b;
+
+	do {
+		if (ip >= iend)
+			return false;
+		b = *ip++;
+		*len += b;
+	} while (b == 255);
+	*ipp = ip;
+	return true;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC into the page at DST.  Returns
+ * false if they are not a whole compressed page. */
+static bool
+lz_decompress (const uint8_t *src, size_t src_len, uint8_t *dst) {
+	const uint8_t *ip = src, *iend = src + src_len;
+	uint8_t *op = dst, *oend = dst + PGSIZE;
+
+	while (ip < iend) {
+		unsigned token = *ip++;
+		size_t len = token >> 4, ofs;
+		const uint8_t *ref;
+
+		if (len == 15 && !get_len (&ip, iend, &len))
+			return false;
+		if (len > (size_t) (iend - ip) || len > (size_t) (oend - op))
+			return false;
+		memcpy (op, ip, len);
+		op += len;
+		ip += len;
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		ofs = ip[0] | (ip[1] << 8);
+		ip += 2;
+		len = token & 15;
+		if (len == 15 && !get_len (&ip, iend, &len))
+			return false;
+		len += MIN_MATCH;
+		if (ofs == 0 || ofs > (size_t) (op - dst)
+				|| len > (size_t) (oend - op))
+			return false;
+
+		/* The match may overlap what it produces. */
+		for (ref = op - ofs; len > 0; len--)
+			*op++ = *ref++;
+	}
+	return op == oend;
+}
+
+/* Compresses the page at KVA and keeps it.  Returns the entry to give
+ * back to zswap_load(), or a null pointer if the page should go to
+ * disk instead. */
+struct zswap_entry *
+zswap_store (const void *kva) {
+	struct zswap_entry *e = NULL;
+	size_t len;
+
+	if (zswap_limit == 0)
+		return NULL;
+
+	lock_acquire (&zswap_lock);
+	len = lz_compress (kva, zbuf, sizeof zbuf);
+	if (len == 0)
+		reject_cnt++;
+	else if (used_bytes + entry_size (len) > zswap_limit * PGSIZE
+			|| (e = malloc (sizeof *e + len)) == NULL)
+		full_cnt++;
+	else {
+		e->len = len;
+		memcpy (e->data, zbuf, len);
+		used_bytes += entry_size (len);
+		if (used_bytes > peak_bytes)
+			peak_bytes = used_bytes;
+		store_cnt++;
+		stored_bytes += entry_size (len);
+	}
+	lock_release (&zswap_lock);
+	return e;
+}
+
+/* Decompresses E into the page at KVA and frees it. */
+void
+zswap_load (struct zswap_entry *e, void *kva) {
+	if (!lz_decompress (e->data, e->len, kva))
+		PANIC ("zswap_load : corrupt compressed page");
+	lock_acquire (&zswap_lock);
+	load_cnt++;
+	lock_release (&zswap_lock);
+	zswap_free (e);
+}
+
+/* Frees E without reading it. */
+void
+zswap_free (struct zswap_entry *e) {
+	lock_acquire (&zswap_lock);
+	used_bytes -= entry_size (e->len);
+	lock_release (&zswap_lock);
+	free (e);
+}
+
+/* Prints statistics about the compressed cache.  DISK_IN_CNT is the
+ * number of swap-ins that went to disk. */
+void
+zswap_print_stats (long long disk_in_cnt) {
+	long long in_cnt = load_cnt + disk_in_cnt;
+
+	printf ("Zswap: %lld of %lld swap-ins hit (%lld%%), %lld pages stored "
+			"at %lld%% of their size, %lld too big, %lld turned away, "
+			"%zu of %zu kB used (peak %zu kB)\n",
+			load_cnt, in_cnt, in_cnt ? load_cnt * 100 / in_cnt : 0,
+			store_cnt, store_cnt ? stored_bytes * 100 / (store_cnt * PGSIZE) : 0,
+			reject_cnt, full_cnt, used_bytes / 1024,
+			zswap_limit * PGSIZE / 1024, peak_bytes / 1024);
+}